@@ -1,8 +1,17 @@
+#define _GNU_SOURCE	/* recvmmsg, sendmmsg, CPU affinity */
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/resource.h> /* RLIMIT_NOFILE */
+#include <sys/wait.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <endian.h> /* le32toh */
 #include <stdio.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
@@ -11,1432 +20,6216 @@
 #include <stdbool.h> /* boolean */
 #include <limits.h> /* INT_MAX */
 #include <ctype.h>
+#include <time.h>
 
-#include <sys/time.h>   /* For FD_SET, FD_SELECT */
-#include <sys/select.h>
-
-#define BUFSIZE 	128
-#define ROUTERA 	10000
-#define ROUTERB		10001
-#define ROUTERC		10002
-#define ROUTERD		10003
-#define ROUTERE		10004
-#define ROUTERF		10005
-#define INDEXA		0
-#define INDEXB		1
-#define INDEXC		2
-#define INDEXD		3
-#define INDEXE		4
-#define INDEXF		5
-#define NUMROUTERS	6
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <immintrin.h> /* SIMD relaxation */
 
+#define PATHSIZE	4096	/* longest output file path */
+#define LOGBUFFER	65536	/* bytes of a router's log held before they are appended to its file */
+#define NAMESIZE	64	/* longest router name read from the console */
+#define ADDRESSSIZE	(INET6_ADDRSTRLEN + 8)	/* "[v6]:port" with its NUL */
+#define STABLETIMEOUT	50000	/* usecs without any triggered DV before the network is stable */
+#define PERIODICUPDATE	30000	/* default msecs between a router's full updates */
+#define PERIODICJITTER	0.25	/* full updates come up to this fraction of the period early */
+#define TRIGGEREDGAP	1	/* default msecs between triggered updates to one neighbor */
+#define RCVBUFSIZE	(4 << 20)	/* requested socket receive buffer, capped by rmem_max */
+#define ARENAALIGN	64	/* arena allocations are cache-line aligned */
+
+/* What a router advertises to a neighbor about routes through that neighbor */
+#define ADVERTISE_ALL	0	/* the route as is */
+#define SPLIT_HORIZON	1	/* nothing */
+#define POISON_REVERSE	2	/* the route, unreachable */
 
 #ifndef max
 	#define max( a, b ) ( ((a) > (b)) ? (a) : (b) )
 #endif
+#ifndef min
+	#define min( a, b ) ( ((a) < (b)) ? (a) : (b) )
+#endif
 
 struct packet
 {
 	char flag;
 	char message[50];
-	char srcNode;
-	char dstNode;
+	int srcNode;
+	int dstNode;
 	int arrivalPort;
 	int forwardingPort;
 };
 
-// struct node is size 84
+/* What forwarding needs of a route, kept apart from the routing state so a
+ * hop is one load.
+ */
+struct fibEntry
+{
+	int nextHop;		/* router id, -1 if unreachable */
+	int port;		/* outgoing port, as logged */
+};
+
+/* Every per-destination array holds one entry per router in the topology and
+ * is carved out of the network arena, so a router is just a view onto its rows.
+ */
 struct router
 {
 	int index;
-	char otherRouters[NUMROUTERS];
-	int costs[NUMROUTERS];
-	int outgoingPorts[NUMROUTERS];
-	int destinationPorts[NUMROUTERS];
+	int *otherRouters;	/* router id of each destination, -1 if unknown */
+	int *costs;
+	int *outgoingPorts;
+	int *destinationPorts;
+	int *nextHop;		/* router id of the next hop, -1 if unreachable */
+	int *feasibleCosts;	/* lowest cost since the last full exchange */
+	unsigned int version;	/* bumped each time the table changes */
+	unsigned int *changedAt;	/* version each destination last changed in */
+	unsigned long long *dirty;	/* bitset of the destinations changed after dirtySince */
+	unsigned int dirtySince;	/* version every live neighbor was last sent all of */
+	struct fibEntry *fib;	/* forwarding table compiled from the routes above */
+	bool backlogged;	/* socket left holding DVs after a capped drain */
+	char *log;		/* LOGBUFFER bytes of output not yet in its file, NULL until used */
+	size_t logLength;
+};
+
+/* A bump allocator over one contiguous block. Everything sized by the
+ * topology is allocated from here and released all at once.
+ */
+struct arena
+{
+	char *base;
+	size_t size;
+	size_t used;
+};
+
+/* A router's socket address, of either family. */
+union socketAddress
+{
+	struct sockaddr sa;
+	struct sockaddr_in in;
+	struct sockaddr_in6 in6;
+};
+
+struct link
+{
+	int src;
+	int dst;
+	int cost;
+};
+
+struct topology
+{
+	int numRouters;
+	char **names;		/* router names, sorted so ids follow name order */
+	int *ports;		/* UDP port each router listens on */
+	struct in6_addr *hosts;	/* and the address, IPv4 mapped into IPv6, :: for none given */
+	int numLinks;
+	struct link *links;
+	int *mapSlots;		/* open-addressed name -> id map, -1 for empty */
+	unsigned int mapMask;
+	void *mapping;		/* binary topology that names and links point into */
+	size_t mappingSize;
+	struct link *linkCopy;	/* the links swapped out of the mapping on a big-endian host */
+};
+
+/* Binary topology file, little-endian whatever the host, laid out as
+ *	header
+ *	uint32_t ports[numRouters]
+ *	uint8_t hosts[numRouters][16]		version 2 on: IPv6 address, IPv4 mapped, :: for none
+ *	uint32_t nameOffsets[numRouters]	into the name table
+ *	char names[namesSize]			NUL-terminated, padded to 4 bytes
+ *	struct link links[numLinks]
+ * Routers are stored in name order, and a cost of INT_MAX marks a dead link.
+ */
+#define TOPOMAGIC	"DVTB"
+#define TOPOVERSION	2
+
+struct topologyHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t numRouters;
+	uint32_t numLinks;
+	uint64_t namesSize;
+};
+
+/* Compressed sparse row neighbor index: router i's links are
+ * neighbors[offsets[i]] .. neighbors[offsets[i+1] - 1], sorted by neighbor id,
+ * with the matching link costs alongside.
+ */
+struct adjacency
+{
+	int *offsets;		/* numRouters + 1 */
+	int *neighbors;
+	int *costs;
+	unsigned int *sentVersion;	/* table version last advertised over each link */
+	long long *sentAt;	/* time of the last update over each link */
+	long long *dueAt;	/* time a coalesced update is queued for, 0 if none */
+};
+
+/* A pending timer: router's periodic full update if link is -1, otherwise
+ * the update coalesced for that link.
+ */
+struct timer
+{
+	long long due;
+	int router;
+	int link;
+};
+
+/* Binary min-heap of timers ordered by due time. Each router has one
+ * periodic timer and each link at most one coalescing timer, so numRouters +
+ * numLinks entries always suffice.
+ */
+struct timerQueue
+{
+	struct timer *heap;
+	int count;
+	long long period;	/* usecs between a router's full updates */
+	long long gap;		/* usecs between triggered updates to one neighbor */
+	int queued;		/* links with a coalesced update waiting */
+	long long lastActivity;	/* last triggered DV or table change */
+	uint64_t jitter;	/* splitmix64 state, one per event loop */
+};
+
+/* DV datagram, all multi-byte fields little-endian:
+ *	uint8_t version, uint8_t flags, uint16_t entry count
+ *	varint sender id, varint sequence number
+ *	count x (varint destination delta, varint cost + 1, 0 if unreachable)
+ * The first destination is coded as itself and each later one as the gap
+ * minus one from the previous. Tables larger than one datagram are split.
+ * Periodic full updates are flagged so receivers can tell them from triggered
+ * ones.
+ */
+#define DVVERSION	1
+#define DVFLAGPERIODIC	0x01	/* part of a periodic full update */
+#define DVHEADERSIZE	4
+#define DVMAXVARINT	5
+#define DVMAXDATAGRAM	1472	/* fits one Ethernet frame */
+#define IOBATCH		64	/* most datagrams moved by one recvmmsg or sendmmsg */
+#define DRAINBATCHES	16	/* most batches drained from one socket before relaxing */
+#define EPOLLEVENTS	256	/* most ready sockets taken from one epoll_wait */
+#define URINGENTRIES	4096	/* io_uring submission queue entries */
+#define URINGCHAINS	8	/* send batches, each free to be filled while the others are in flight */
+#define URINGBUFFERS	4096	/* provided receive buffers, a power of two */
+#define URINGGROUP	0	/* their buffer group */
+#define URINGRECV	1ULL	/* completion kinds, in the user data above the router id */
+#define URINGSEND	2ULL
+#define WORKERPOLL	(STABLETIMEOUT / 10)	/* usecs between the coordinator's looks at its workers */
+#define TASKBATCH	256	/* most tasks a worker runs before looking at its sockets and timers again */
+#define TIMERRETRY	100	/* usecs before a timer whose router is busy elsewhere, or whose
+				 * neighbor's mailbox was full, fires again */
+#define MAILBOXSLOTS	8	/* datagram slots per directed link, a power of two */
+
+/* Where a router stands with the workers. Only the worker that took it from
+ * a queue or acquired it runs it, so each router is handled by one thread at a
+ * time; a router notified while running is queued again when it finishes.
+ */
+#define ROUTERIDLE	0
+#define ROUTERQUEUED	1	/* in some worker's queue */
+#define ROUTERRUNNING	2
+#define ROUTERNOTIFIED	3	/* running, and its socket became readable again */
+
+/* Supervisor commands to a router process, over its control socket */
+#define COMMANDSTART	1	/* run until stopped, taking a killed router down first */
+#define COMMANDREFRESH	2	/* send every neighbor a full update */
+#define COMMANDSTOP	3	/* report the table and wait */
+#define COMMANDDRAIN	4	/* discard every queued DV */
+#define COMMANDEXIT	5
+
+/* and a router process's reports back */
+#define REPORTSTATUS	1
+#define REPORTDRAINED	2
+#define REPORTSTOPPED	3	/* sent after the whole table */
+#define REPORTROUTES	4	/* followed by routes first .. as struct reportedRoute */
+#define REPORTCHUNK	2048	/* routes per REPORTROUTES, well inside a socket buffer */
+
+/* simulator */
+#define SIMDELAY	100	/* default usecs of the shortest link delay, well inside TRIGGEREDGAP */
+#define SIMTICK		100	/* usecs between a router's looks at its inbox */
+#define SIMSLAB		256	/* events allocated at once */
+
+/* all-pairs solver */
+#define DENSEGRAPH	4	/* Floyd-Warshall once links make up 1 / DENSEGRAPH of all pairs */
+#define FWBLOCK		64	/* Floyd-Warshall block side, three int blocks fitting in L1 */
+
+struct distanceVector
+{
+	int sender;
+	unsigned int seq;
+	unsigned int flags;
+	int count;
+	int *dests;
+	int *costs;		/* INT_MAX for unreachable */
+};
+
+/* DVs drained from one socket and decoded, waiting to be merged. Vector k
+ * holds entries first .. first + count - 1 of dests and costs.
+ */
+struct drainedVector
+{
+	int sender;
+	unsigned int seq;
+	unsigned int flags;
+	int first;
+	int count;
+};
+
+struct drain
+{
+	struct drainedVector *vectors;
+	int numVectors;
+	int maxVectors;
+	int *dests;
+	int *costs;
+	int numEntries;
+	int maxEntries;
+	int *slot;		/* per destination, its entry in the merged DV or -1 */
+	bool more;		/* the socket may still hold DVs */
+};
+
+struct dvWriter
+{
+	unsigned char *buf;
+	size_t len;
+	int count;
+	int lastDest;
+};
+
+/* Datagrams moved by one recvmmsg or sendmmsg: IOBATCH DVMAXDATAGRAM-sized
+ * slots with their message headers. Queued sends all go out on sockfd.
+ */
+struct ioBatch
+{
+	unsigned char *bufs;
+	struct mmsghdr *msgs;
+	struct iovec *iovs;
+	int count;
+	int sockfd;
+};
+
+/* Single-producer single-consumer ring of datagram slots for one directed
+ * link: the sending router fills slots at head, the receiving router empties
+ * them at tail. Each router is only run by one thread at a time, so the two
+ * counters are all the synchronization needed.
+ */
+struct mailbox
+{
+	unsigned int head __attribute__((aligned(ARENAALIGN)));	/* written by the sender */
+	unsigned int tail __attribute__((aligned(ARENAALIGN)));	/* written by the receiver */
+	unsigned int taken;	/* slots handed out by the receiver's last receive() */
+	unsigned short lens[MAILBOXSLOTS];
+};
+
+/* How DVs travel between routers. Router i writes the DV for the neighbor on
+ * link e into buffer(), NULL if that link can take no more for now, and hands
+ * it over with send(); flush() pushes out whatever send() queued. receive()
+ * returns DVs waiting for router i, which stay valid until its next
+ * receive() or release(). kick() gets router i to advertise its table.
+ */
+struct network;
+
+struct transport
+{
+	unsigned char *(*buffer)(struct network *net, int i, int e);
+	void (*send)(struct network *net, int i, int e, size_t len);
+	void (*flush)(struct network *net);
+	int (*receive)(struct network *net, int i, unsigned char **bufs, size_t *lens);
+	void (*release)(struct network *net, int i);
+	void (*kick)(struct network *net, int i);
+};
+
+/* A received datagram reaped from the completion ring: router's socket got
+ * len bytes in provided buffer bid.
+ */
+struct completion
+{
+	int router;
+	int bid;
+	int len;
+};
+
+/* io_uring backend, driven with raw system calls. Every router socket keeps a
+ * multishot receive posted that takes its buffers from one provided buffer
+ * ring; completions are reaped into ready and handled router by router.
+ */
+struct uring
+{
+	int fd;
+	void *sqRing;
+	size_t sqRingSize;
+	void *cqRing;
+	size_t cqRingSize;
+	struct io_uring_sqe *sqes;
+	size_t sqesSize;
+	unsigned int *sqHead;
+	unsigned int *sqTail;
+	unsigned int *sqArray;
+	unsigned int sqMask;
+	unsigned int sqEntries;
+	unsigned int toSubmit;	/* SQEs written since the last io_uring_enter */
+	unsigned int *cqHead;
+	unsigned int *cqTail;
+	unsigned int cqMask;
+	struct io_uring_cqe *cqes;
+	struct io_uring_buf_ring *bufRing;
+	size_t bufRingSize;
+	unsigned char *bufs;	/* URINGBUFFERS x DVMAXDATAGRAM */
+	unsigned short bufTail;
+	struct arena chainArena;
+	struct ioBatch chains[URINGCHAINS];	/* net->out fills chains[chain] */
+	int inFlight[URINGCHAINS];	/* sends of each chain not yet completed */
+	int chain;
+	int sendsInFlight;
+	struct completion *ready;	/* reaped, not yet handled */
+	int numReady;
+	struct completion *handling;
+	bool *armed;		/* per router, a multishot receive is posted */
+	int *rearm;		/* routers whose receive ended */
+	int numRearm;
+	bool unsupported;	/* the kernel refused a multishot receive */
+};
+
+struct stats
+{
+	unsigned long datagramsSent;
+	unsigned long bytesSent;
+	unsigned long datagramsReceived;
+	unsigned long sendCalls;
+	unsigned long receiveCalls;
+	unsigned long tasksRun;
+	unsigned long tasksStolen;
+};
+
+/* Ring of router ids queued for a worker: only the owner pushes, at the
+ * tail, while the owner and other workers alike take from the head with a
+ * compare-and-swap, so routers run in the order they were queued whoever
+ * runs them. A router sits in at most one queue at a time, so mask + 1 >=
+ * numRouters slots never run out.
+ */
+struct taskQueue
+{
+	long long head __attribute__((aligned(ARENAALIGN)));
+	long long tail __attribute__((aligned(ARENAALIGN)));
+	int *tasks;
+	long long mask;
+};
+
+/* A DV in flight in the simulator, to router. Every event has room for the
+ * largest DV, so spent ones are kept on a free list and reused.
+ */
+struct simEvent
+{
+	int router;
+	size_t len;
+	struct simEvent *next;	/* in router's inbox, among those held, or free */
+	unsigned char data[DVMAXDATAGRAM];
+};
+
+/* Where an event sits in the simulator's heap: due at virtual time at, seq
+ * ordering the events due at once the way they were sent. The keys live in
+ * the heap itself, so sifting never touches the events.
+ */
+struct simPending
+{
+	long long at;
+	unsigned long long seq;
+	struct simEvent *ev;
+};
+
+/* SIMSLAB events allocated at once, chained so they can be freed. */
+struct simSlab
+{
+	struct simSlab *next;
+	struct simEvent events[SIMSLAB];
+};
+
+/* Discrete-event simulation of the network in virtual time. Every DV sent
+ * becomes an event due once its link's delay has passed; the loop jumps
+ * straight from one event or timer to the next, so nothing ever waits.
+ */
+struct simulation
+{
+	long long now;		/* virtual usecs since the simulation began */
+	long long settled;	/* wall-clock usecs at which a table last changed */
+	unsigned int seed;
+	long long *delays;	/* per link */
+	struct simPending *heap;	/* DVs in flight, earliest first */
+	int count;
+	int capacity;
+	struct simEvent *free;	/* spent events */
+	struct simSlab *slabs;
+	struct simEvent *writing;	/* the one simBuffer() handed out */
+	unsigned long long sent;	/* numbers the events */
+	unsigned long long delivered;
+	struct simEvent **inHead;	/* per router, DVs delivered but not yet received */
+	struct simEvent **inTail;
+	struct simEvent *held;	/* taken by the last receive() */
+	int *ready;		/* routers delivered to at this instant */
+};
+
+/* A router reached at cost in a Dijkstra search. */
+struct pathEntry
+{
+	int cost;
+	int router;
+};
+
+/* Shortest paths from sources first .. last - 1 into tables: each thread
+ * takes the next source left until none are.
+ */
+struct allPairs
+{
+	struct network *net;
+	struct router *tables;	/* costs and nextHop of each source */
+	int nextSource;
+	int last;
+};
+
+/* One thread's block of routers in a synchronous round. */
+struct roundWorker
+{
+	struct network *net;
+	pthread_t thread;
+	int id;
+	int first;
+	int last;
+};
+
+/* Synchronous Bellman-Ford over the whole network. In round r every router
+ * recomputes its vector from its neighbors' vectors of round r - 1 alone:
+ * costs holds the two generations, row i of each being router i's vector,
+ * and the threads meet at the barrier after every round. When every cost
+ * below the infinity metric fits in 16 bits, the costs are kept that
+ * narrow, USHRT_MAX standing for unreachable, and twice as many go through
+ * the cache and the relaxation kernel at once. Each vector's dirty bits mark
+ * the destinations it improved in its round; a router only relaxes against
+ * the 64-destination blocks of a neighbor's vector that hold one.
+ */
+struct rounds
+{
+	void *costs[2];		/* n x n, indexed by round parity */
+	bool narrow;		/* unsigned short costs instead of int */
+	size_t costSize;
+	int *nextHop;		/* n x n, of the latest round */
+	unsigned long long *dirty[2];	/* n x words, indexed by round parity */
+	int words;		/* (n + 63) / 64 */
+	struct roundWorker *workers;
+	int numWorkers;
+	pthread_barrier_t barrier;
+	long long *changes;	/* per worker, by round parity: [2 * worker + (r & 1)] */
+	void (*relax)(int *costs, int *hops, const int *theirs, int link, int neighbor, int n,
+		unsigned long long *changed);	/* widest min-plus kernel the CPU runs */
+	void (*relaxNarrow)(unsigned short *costs, int *hops, const unsigned short *theirs, int link,
+		int neighbor, int n, unsigned long long *changed);
+	const char *kernel;
+	long long *perRound;	/* costs changed in each round */
+	int count;
+	int capacity;
+};
+
+struct network
+{
+	int numRouters;
+	int firstRouter;	/* routers this event loop owns: first .. last - 1 */
+	int lastRouter;
+	struct topology topo;
+	struct arena arena;
+	struct router *routers;
+	struct adjacency adj;
+	bool *killed;
+	int infinity;		/* smallest cost treated as unreachable */
+	int advertise;		/* ADVERTISE_ALL, SPLIT_HORIZON or POISON_REVERSE */
+	int *sockfd;
+	int epollfd;		/* every router socket, edge-triggered */
+	int *backlog;		/* routers to service again without waiting */
+	int numBacklogged;
+	union socketAddress *serveraddr;
+	unsigned int *seq;	/* next DV sequence number of each router */
+	unsigned char *buf;	/* one DV datagram */
+	const struct transport *transport;
+	bool batched;		/* move datagrams with recvmmsg/sendmmsg */
+	bool ringed;		/* move datagrams with io_uring instead */
+	struct uring uring;
+	struct ioBatch in;
+	struct ioBatch out;
+	struct distanceVector rcvd;	/* scratch for decoded DVs */
+	struct drain drain;
+	struct timerQueue timers;
+	struct stats stats;
+	int wakefd;		/* eventfd that cuts this loop's wait short, -1 if none */
+	struct worker *workers;	/* worker threads, none to run everything on this one */
+	int numWorkers;
+	pthread_barrier_t barrier;	/* workers meet here before their loops start */
+	unsigned int refresh;	/* bumped to have every worker refresh its tables */
+	bool stopping;		/* workers leave their loops */
+	int killing;		/* router to take down when the loop starts, or -1 */
+	int *taskState;		/* per router, ROUTERIDLE .. ROUTERNOTIFIED; NULL without workers */
+	struct taskQueue *tasks;	/* this worker's queue */
+	int *wokenRouters;	/* routers this worker put DVs in the mailboxes of, to queue */
+	bool *isWoken;
+	int numWoken;
+	struct mailbox *mailboxes;	/* per link, with the in-process transport */
+	unsigned char *mailboxSlots;	/* MAILBOXSLOTS x DVMAXDATAGRAM per link */
+	int *inOffsets;		/* router i's incoming links are inLinks[inOffsets[i]] .. */
+	int *inLinks;
+	int held[IOBATCH];	/* links the last receive() took slots from */
+	int numHeld;
+	bool woken;		/* wakefd fired during the last poll */
+	struct process *processes;	/* one per router when each runs as its own process */
+	int numProcesses;
+	int kicking;		/* router to advertise first when the processes start, or -1 */
+	struct simulation *sim;	/* the network is simulated, NULL if it runs for real */
+	struct rounds *rounds;	/* the tables are computed in synchronous rounds, or NULL */
+};
+
+/* A worker thread. It watches the sockets of a contiguous block of home
+ * routers and queues each that becomes readable as a task on its queue, runs
+ * tasks from there and steals from other workers when it runs dry. Its net
+ * is a view of the shared network: tables, links and sockets are shared,
+ * each router handled by one worker at a time, while the loop state (epoll
+ * instance, timers, batches, drain and stats) is the worker's.
+ */
+struct worker
+{
+	struct network net;
+	struct network *shared;
+	struct taskQueue tasks;
+	pthread_t thread;
+	int id;
+	int cpu;		/* CPU the worker is pinned to, or -1 */
+	unsigned int seed;	/* picks the first worker to steal from */
+	bool sleeping;		/* waiting with every queue empty */
+	/* published to the coordinator */
+	long long lastActivity;
+	long long convergedAt;	/* last time one of its tables changed */
+	int changes;		/* since the coordinator last took them */
+	bool busy;		/* coalesced updates queued or routers backlogged */
+	unsigned int refreshed;	/* last refresh generation carried out */
+};
+
+struct command
+{
+	int kind;		/* COMMANDSTART .. COMMANDEXIT */
+	int killing;		/* router to take down first, or -1 */
+	int kick;		/* router to advertise first, or -1 */
+	unsigned int refresh;	/* refresh generation */
+};
+
+/* What a router process tells the supervisor: its loop's state before it
+ * waits and as it wakes to work, the same as a worker publishes, and at the
+ * end of a phase its counters and resource use too.
+ */
+struct report
+{
+	int kind;		/* REPORTSTATUS .. REPORTROUTES */
+	int first;		/* routes first .. first + count - 1 follow a REPORTROUTES */
+	int count;
+	bool busy;		/* coalesced updates queued */
+	unsigned int refreshed;	/* last refresh generation carried out */
+	int changes;		/* table changes since the last report */
+	long long lastActivity;
+	long long convergedAt;	/* last time the table changed, 0 if it has not */
+	struct stats stats;	/* this phase's, once stopped */
+	long long cpuUsec;	/* user and system time so far, once stopped */
+	long maxRss;		/* peak resident set in KB, once stopped */
+};
+
+/* A route of a stopped router process's table. */
+struct reportedRoute
+{
+	int cost;
+	struct fibEntry fib;
 };
 
+/* A router process, as the supervisor sees it. */
+struct process
+{
+	pid_t pid;
+	int ctlfd;		/* the supervisor's end of the control socket */
+	bool alive;
+	bool drained;
+	bool stopped;
+	struct report status;	/* the last report */
+	int changes;		/* reported since the supervisor last took them */
+};
+
+void error(char *msg) {
+	perror(msg);
+	exit(1);
+}
+
+/* arenaInit()
+ *
+ * Reserves one contiguous block of the given size for the arena.
+ */
+void arenaInit(struct arena *a, size_t size)
+{
+	a->base = aligned_alloc(ARENAALIGN, (size + ARENAALIGN - 1) & ~(size_t) (ARENAALIGN - 1));
+	if (a->base == NULL)
+		error("Error allocating router tables");
+	a->size = size;
+	a->used = 0;
+}
+
+/* arenaAlloc()
+ *
+ * Returns the next cache-line aligned chunk of the arena.
+ */
+void *arenaAlloc(struct arena *a, size_t size)
+{
+	size_t offset = (a->used + ARENAALIGN - 1) & ~(size_t) (ARENAALIGN - 1);
+	if (offset + size > a->size) {
+		fprintf(stderr, "Router arena exhausted (%zu of %zu bytes)\n", offset + size, a->size);
+		exit(1);
+	}
+	a->used = offset + size;
+	return a->base + offset;
+}
+
+/* arenaFree()
+ *
+ * Releases everything allocated from the arena.
+ */
+void arenaFree(struct arena *a)
+{
+	free(a->base);
+	a->base = NULL;
+	a->size = a->used = 0;
+}
+
+/* arenaBytes()
+ *
+ * Returns the arena space needed for count objects of the given size.
+ */
+size_t arenaBytes(size_t count, size_t size)
+{
+	return (count * size + ARENAALIGN - 1) & ~(size_t) (ARENAALIGN - 1);
+}
+
+/* routerName()
+ *
+ * Returns the name of router id, or "" for an unknown id.
+ */
+const char *routerName(struct network *net, int id)
+{
+	if (id < 0 || id >= net->numRouters)
+		return "";
+	return net->topo.names[id];
+}
+
 /* printRouter()
  *
  * Prints out the given router table.
  */
-void printRouter(struct router* r)
+void printRouter(struct network *net, struct router* r)
 {
         printf("*** ROUTER INFO ***\nIndex: %d\n", r->index);
         printf("otherRouters\tcosts\t\toutgoingPorts\tdestPorts\n");
         int i;
-        for (i=0; i < NUMROUTERS; i++)
-                printf("%c\t\t%d\t\t%d\t\t%d\n", r->otherRouters[i], r->costs[i], r->outgoingPorts[i], r->destinationPorts[i]);
+        for (i=0; i < net->numRouters; i++)
+                printf("%s\t\t%d\t\t%d\t\t%d\n", routerName(net, r->otherRouters[i]), r->costs[i], r->outgoingPorts[i], r->destinationPorts[i]);
         printf("*** END RTRINFO ***\n");
 }
 
 /* printBuffer()
  *
- * Prints out the given int buffer.
+ * Prints out the given datagram bytes in hex.
  */
-void printBuffer(int * buf, size_t size)
+void printBuffer(unsigned char * buf, size_t size)
 {
-	int i;
+	size_t i;
 	for (i = 0; i < size; i++)
-		printf("%d ", buf[i]);
+		printf("%02x ", buf[i]);
 	printf("\n");
 }
 
-struct matrix
-{
-	int r[NUMROUTERS][NUMROUTERS];
-};
-
-void error(char *msg) {
-	perror(msg);
-	exit(1);
-}
-
 /* getTime()
  *
  * Returns a string containing the time down to the milliseconds
  */
-char* getTime() {
+char* getTime(struct network *net) {
 	struct timeval tval;
 	struct tm* ptm;
+	struct tm tm;
 	char time_string[40] = {'\0'};
 	long milliseconds;
-	char t[512] = {'\0'};
+	static __thread char t[512];
 
-	gettimeofday(&tval, NULL);
-	ptm = localtime(&tval.tv_sec);
+	if (net->sim != NULL) {
+		// virtual time counts from the epoch, so simulated runs read the same
+		tval.tv_sec = net->sim->now / 1000000;
+		tval.tv_usec = net->sim->now % 1000000;
+		ptm = gmtime_r(&tval.tv_sec, &tm);
+	} else {
+		gettimeofday(&tval, NULL);
+		ptm = localtime_r(&tval.tv_sec, &tm);
+	}
 	strftime(time_string, sizeof(time_string), "%Y-%m-%d %H:%M:%S", ptm);
 	milliseconds = tval.tv_usec/1000;
 	sprintf(t, "%s.%03ld\n", time_string, milliseconds);
 	return t;
 }
 
-/* tableToBuffer()
+/* nowUsec()
  *
- * Converts a router struct representation into an int buffer representation of a router.
+ * Returns monotonic time in microseconds, for timers.
  */
-void tableToBuffer(struct router *table, int *buf) {
-	
-	int offset = 0;
-	buf[offset] = table->index;
-	offset++;
+long long nowUsec()
+{
+	struct timespec ts;
 
-	int i;
-	for (i = 0; i < NUMROUTERS; i++)
-	{
-		buf[offset + 0*NUMROUTERS] = (int) table->otherRouters[i];
-		buf[offset + 1*NUMROUTERS] = table->costs[i];
-		buf[offset + 2*NUMROUTERS] = table->outgoingPorts[i];
-		buf[offset + 3*NUMROUTERS] = table->destinationPorts[i];
-		offset++;
-	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
-/* bufferToTable()
+/* clockUsec()
  *
- * Converts an integer array representation into a struct representation of a router.
+ * Returns the network's time in microseconds: virtual if it is simulated,
+ * monotonic otherwise.
  */
-void bufferToTable(int *buf, struct router *table) {
+long long clockUsec(struct network *net)
+{
+	return net->sim != NULL ? net->sim->now : nowUsec();
+}
 
-	int offset = 0;
-	table->index = buf[offset];
-	offset++;
+/* pushTimer()
+ *
+ * Adds a timer to the queue.
+ */
+void pushTimer(struct timerQueue *q, long long due, int router, int link)
+{
+	int k = q->count++;
 
-	int i;
-	for (i = 0; i < NUMROUTERS; i++)
-	{
-		table->otherRouters[i] = (char) buf[offset + 0*NUMROUTERS];
-		table->costs[i] =		buf[offset + 1*NUMROUTERS];
-		table->outgoingPorts[i] =	buf[offset + 2*NUMROUTERS];
-		table->destinationPorts[i] =	buf[offset + 3*NUMROUTERS];
-		offset++;
+	while (k > 0 && q->heap[(k - 1) / 2].due > due) {
+		q->heap[k] = q->heap[(k - 1) / 2];
+		k = (k - 1) / 2;
 	}
+	q->heap[k].due = due;
+	q->heap[k].router = router;
+	q->heap[k].link = link;
 }
 
-/* outputTable()
+/* popTimer()
  *
- * Writes the routing table to its output file.
+ * Removes the earliest timer from the queue into t. Returns false if the
+ * queue is empty.
  */
-void outputTable(struct router *table, bool isStable) {
-	FILE *f = NULL;
-        int timeBufferSize = 64;
-        char timeBuffer[timeBufferSize];
+bool popTimer(struct timerQueue *q, struct timer *t)
+{
+	struct timer last;
+	int k = 0, child;
 
-	switch (table->index) {
-		case INDEXA:
-			f = fopen("routing-outputA.txt", "a");
-			break;
-		case INDEXB:
-			f = fopen("routing-outputB.txt", "a");
-			break;
-		case INDEXC:
-			f = fopen("routing-outputC.txt", "a");
-			break;
-		case INDEXD:
-			f = fopen("routing-outputD.txt", "a");
-			break;
-		case INDEXE:
-			f = fopen("routing-outputE.txt", "a");
-			break;
-		case INDEXF:
-			f = fopen("routing-outputF.txt", "a");
+	if (q->count == 0)
+		return false;
+	*t = q->heap[0];
+	last = q->heap[--q->count];
+	while ((child = 2 * k + 1) < q->count) {
+		if (child + 1 < q->count && q->heap[child + 1].due < q->heap[child].due)
+			child++;
+		if (last.due <= q->heap[child].due)
 			break;
+		q->heap[k] = q->heap[child];
+		k = child;
 	}
+	q->heap[k] = last;
+	return true;
+}
 
-	if (!isStable) {
-	    // time_t ltime;
-	    // struct tm* timeinfo;
-
-	    // time(&ltime);
-	    // timeinfo = localtime(&ltime);
-	    // snprintf(timeBuffer, timeBufferSize, "%ld", timeinfo);
-	    char *t = getTime();
-	    fprintf(f, "\nTimestamp: %s\nDestination, Cost, Outgoing Port, Destination Port\n", t);
-	} else {
-		fprintf(f, "\nTable in Stable State\nDestination, Cost, Outgoing Port, Destination Port\n");
+/* putVarint()
+ *
+ * Writes v as a little-endian base-128 varint and returns its length.
+ */
+size_t putVarint(unsigned char *buf, unsigned int v)
+{
+	size_t len = 0;
+	while (v >= 0x80) {
+		buf[len++] = (unsigned char) (v | 0x80);
+		v >>= 7;
 	}
-
-	int i;
-    for (i=0; i<NUMROUTERS; i++) {
-    	fprintf(f, "%c %i %i %i\n",
-    		table->otherRouters[i],
-    		table->costs[i],
-    		table->outgoingPorts[i],
-    		table->destinationPorts[i]);
-    }
-	fclose(f);
-    return;
+	buf[len++] = (unsigned char) v;
+	return len;
 }
 
-/* getDestPortIndex()
+/* getVarint()
  *
- * Returns the index of the portno in the table's destination array
+ * Reads a varint at *pos without running past len, advancing *pos. Returns
+ * false for a truncated or over-long varint.
  */
-int getDestPortIndex(struct router* table, int portno) {
-	int i;
-	for (i=0; i<NUMROUTERS; i++) {
-		if (table->destinationPorts[i] == portno)
-			return i;
+bool getVarint(const unsigned char *buf, size_t len, size_t *pos, unsigned int *v)
+{
+	unsigned int value = 0;
+	int shift;
+
+	for (shift = 0; shift < 7 * DVMAXVARINT; shift += 7) {
+		if (*pos >= len)
+			return false;
+		unsigned char byte = buf[(*pos)++];
+		if (shift == 28 && byte > 0x0f)
+			return false;
+		value |= (unsigned int) (byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			*v = value;
+			return true;
+		}
 	}
+	return false;
 }
 
-/* routerToPort()
+/* beginVector()
  *
- * Returns the Router PORTNO given the name
+ * Starts a DV datagram from the given sender in buf.
  */
-int routerToPort(char r) {
-	switch (r)
-	{
-		case 'a':
-		case 'A':
-			return ROUTERA;
-			break;
-		case 'b':
-		case 'B':
-			return ROUTERB;
-			break;
-		case 'c':
-		case 'C':
-			return ROUTERC;
-			break;
-		case 'd':
-		case 'D':
-			return ROUTERD;
-			break;
-		case 'e':
-		case 'E':
-			return ROUTERE;
-			break;
-		case 'f':
-		case 'F':
-			return ROUTERF;
-			break;
-	}
+void beginVector(struct dvWriter *w, unsigned char *buf, int sender, unsigned int seq, unsigned int flags)
+{
+	w->buf = buf;
+	buf[0] = DVVERSION;
+	buf[1] = (unsigned char) flags;
+	w->len = DVHEADERSIZE;
+	w->len += putVarint(buf + w->len, (unsigned int) sender);
+	w->len += putVarint(buf + w->len, seq);
+	w->count = 0;
+	w->lastDest = -1;
 }
 
-/* portToRouter()
+/* addEntry()
  *
- * Returns the router name given the port
+ * Appends a (destination, cost) entry, delta coding the destination against
+ * the previous one. Destinations must be added in increasing order. Returns
+ * false, leaving the datagram unchanged, once the datagram is full.
  */
-char portToRouter(int portno) {
-	switch (portno)
-	{
-		case ROUTERA:
-			return 'A';
-			break;
-		case ROUTERB:
-			return 'B';
-			break;
-		case ROUTERC:
-			return 'C';
-			break;
-		case ROUTERD:
-			return 'D';
-			break;
-		case ROUTERE:
-			return 'E';
-			break;
-		case ROUTERF:
-			return 'F';
-			break;
-	}
+bool addEntry(struct dvWriter *w, int dest, int cost)
+{
+	if (w->len + 2 * DVMAXVARINT > DVMAXDATAGRAM || w->count == 0xffff)
+		return false;
+	w->len += putVarint(w->buf + w->len, (unsigned int) (dest - w->lastDest - 1));
+	// cost 0 on the wire means unreachable
+	w->len += putVarint(w->buf + w->len, cost == INT_MAX ? 0 : (unsigned int) cost + 1);
+	w->lastDest = dest;
+	w->count++;
+	return true;
 }
 
-/* tableName()
+/* endVector()
  *
- * Returns the name of the table given the DV
+ * Fills in the entry count and returns the datagram length.
  */
-char tableName(struct router* table) {
-	int i;
-	for (i=0; i<NUMROUTERS; i++) {
-		if (table->costs[i] == 0) {
-			switch(i)
-			{
-				case 0:
-					return 'A';
-					break;
-				case 1:
-					return 'B';
-					break;
-				case 2:
-					return 'C';
-					break;
-				case 3:
-					return 'D';
-					break;
-				case 4:
-					return 'E';
-					break;
-				case 5:
-					return 'F';
-					break;
-			}
-		}
-	}
+size_t endVector(struct dvWriter *w)
+{
+	w->buf[2] = (unsigned char) (w->count & 0xff);
+	w->buf[3] = (unsigned char) (w->count >> 8);
+	return w->len;
 }
 
-/* updateTable()
+/* decodeVector()
  *
- * Updates table if possible. If table is changed, output to file.
+ * Decodes a DV datagram into dv, checking every field against the datagram
+ * length and the size of the network. Returns false for a malformed or
+ * foreign datagram, which is then ignored.
  */
-bool updateTable(struct router *currTable, struct router rcvdTable) {
-	bool isChanged = false;
-	int i;
-	for (i=0; i<NUMROUTERS; i++) {
-		// ignore own entry in table
-		if (i != currTable->index) {
-			// find shortest paths to other routers
-			if (rcvdTable.costs[i] == INT_MAX) {
-				continue;
-			} else if ( currTable->costs[i] > rcvdTable.costs[i] + currTable->costs[rcvdTable.index] ) {
+bool decodeVector(struct network *net, const unsigned char *buf, size_t len, struct distanceVector *dv)
+{
+	unsigned int sender, seq, delta, cost;
+	size_t pos = DVHEADERSIZE;
+	int count, k;
+	long long dest = -1;
 
-				currTable->otherRouters[i] = rcvdTable.otherRouters[i];
-				currTable->costs[i] = rcvdTable.costs[i] + currTable->costs[rcvdTable.index];
-				currTable->outgoingPorts[i] = rcvdTable.index + 10000;
-				currTable->destinationPorts[i] = rcvdTable.destinationPorts[i];
+	if (len < DVHEADERSIZE || buf[0] != DVVERSION)
+		return false;
+	count = buf[2] | buf[3] << 8;
+	if (!getVarint(buf, len, &pos, &sender) || !getVarint(buf, len, &pos, &seq)
+			|| sender >= (unsigned int) net->numRouters || count > net->numRouters)
+		return false;
 
-				isChanged = true;
-			}
-		}
-	}
-	if (isChanged) {
-		outputTable(currTable, false);
+	for (k = 0; k < count; k++) {
+		if (!getVarint(buf, len, &pos, &delta) || !getVarint(buf, len, &pos, &cost))
+			return false;
+		dest += (long long) delta + 1;
+		if (dest >= net->numRouters)
+			return false;
+		dv->dests[k] = (int) dest;
+		dv->costs[k] = cost == 0 || cost - 1 > INT_MAX ? INT_MAX : (int) (cost - 1);
 	}
-	return isChanged;
+	if (pos != len)
+		return false;
+
+	dv->sender = (int) sender;
+	dv->seq = seq;
+	dv->flags = buf[1];
+	dv->count = count;
+	return true;
 }
 
-/* outputPacket()
+/* openOutputFile()
  *
- * Writes packet info to the router output file 
+ * Opens routing-outputX.txt for the given router.
  */
-void outputPacket(struct router *table, struct packet *p, bool isDestination) {
-	// write to output timestamp, src node, dst node, arrival UDP port, and outgoing UDP port
-	FILE *f = NULL;
-	int timeBufferSize = 64;
-	char timeBuffer[timeBufferSize];
-
-	switch (table->index) {
-		case INDEXA:
-			f = fopen("routing-outputA.txt", "a");
-			break;
-		case INDEXB:
-			f = fopen("routing-outputB.txt", "a");
-			break;
-		case INDEXC:
-			f = fopen("routing-outputC.txt", "a");
-			break;
-		case INDEXD:
-			f = fopen("routing-outputD.txt", "a");
-			break;
-		case INDEXE:
-			f = fopen("routing-outputE.txt", "a");
-			break;
-		case INDEXF:
-			f = fopen("routing-outputF.txt", "a");
-			break;
-	}
-
-	// time_t ltime;
-	// struct tm* timeinfo;
-
-	// time(&ltime);
-	// timeinfo = localtime(&ltime);
-	// snprintf(timeBuffer, timeBufferSize, "%ld", timeinfo);
+FILE *openOutputFile(struct network *net, int id, const char *mode)
+{
+	char path[PATHSIZE];
+	snprintf(path, sizeof(path), "routing-output%s.txt", routerName(net, id));
 
-	char *t = getTime();
-	if (!isDestination) {
-		int destIndex;
-		char tname;
+	FILE *f = fopen(path, mode);
+	if (f == NULL)
+		error("Error opening file");
+	return f;
+}
 
-		destIndex = getDestPortIndex(table, routerToPort(p->dstNode));
-		tname = tableName(table);
+/* flushLog()
+ *
+ * Appends what table's router has logged to its output file.
+ */
+void flushLog(struct network *net, struct router *table)
+{
+	FILE *f;
 
-		fprintf(f, "\nReceived data packet:\nTimestamp: %s\nSource Node: %c\nDestination Node: %c\nArrival UDP Port: %i\nOutgoing UDP Port: %i\n", t, p->srcNode, p->dstNode, routerToPort(tname), table->outgoingPorts[destIndex]);
-	} else {
-		fprintf(f, "\nCumulative information about data packet:\nTimestamp: %s\nMessage: %s\nSource Node: %c\nDestination Node: %c\nArrival (Destination) UDP Port: %i\n", t, p->message, p->srcNode, p->dstNode, routerToPort(p->dstNode));
-	}
+	if (table->logLength == 0)
+		return;
+	f = openOutputFile(net, table->index, "a");
+	fwrite(table->log, 1, table->logLength, f);
 	fclose(f);
+	table->logLength = 0;
 }
 
-/* routerToTable()
+/* flushLogs()
  *
- * Returns the DV given the router name
+ * Appends what every router has logged to its output file.
  */
-struct router* routerToTable(struct router** network, char r) {
-	switch(r)
-	{
-		case 'a':
-		case 'A':
-			return network[0];
-			break;
-		case 'b':
-		case 'B':
-			return network[1];
-			break;
-		case 'c':
-		case 'C':
-			return network[2];
-			break;
-		case 'd':
-		case 'D':
-			return network[3];
-			break;
-		case 'e':
-		case 'E':
-			return network[4];
-			break;
-		case 'f':
-		case 'F':
-			return network[5];
-			break;
-	}
+void flushLogs(struct network *net)
+{
+	int i;
+
+	for (i = 0; i < net->numRouters; i++)
+		flushLog(net, &net->routers[i]);
 }
 
-/* forwardPacket()
+/* appendLog()
  *
- * Forwards a packet from the source to destination
+ * Logs a line or so for table's router, printf style. Its log is held in
+ * memory and only written out a LOGBUFFER at a time, or when flushed, so
+ * that a change does not cost an open, a write and a close of the file.
  */
-void forwardPacket(struct packet *p, struct router** network) {
-	char src = p->srcNode;
-	char dst = p->dstNode;
-	int index = 0;
-	int i;
-
-	int destIndex;
-	int outgoing;
-	char nextRouter;
-
-	struct router* curr = malloc(NUMROUTERS * sizeof(struct router));
-	curr = routerToTable(network, src);
-	p->arrivalPort = routerToPort(tableName(curr));
-	while (tableName(curr) != dst) {
-		destIndex = getDestPortIndex(curr, routerToPort(dst));
-		outgoing = curr->outgoingPorts[destIndex];
-		p->forwardingPort = outgoing;
-		outputPacket(curr, p, false);
-		if (outgoing == routerToPort(tableName(curr))) {
-			// next router is going to be destination router
-			break;
-		}
+__attribute__((format(printf, 3, 4)))
+void appendLog(struct network *net, struct router *table, const char *format, ...)
+{
+	va_list args;
+	int len;
 
-		nextRouter = portToRouter(outgoing);
-		curr = routerToTable(network, nextRouter);
-		index++;
+	if (table->log == NULL && (table->log = malloc(LOGBUFFER)) == NULL)
+		error("Error allocating log");
+	va_start(args, format);
+	len = vsnprintf(table->log + table->logLength, LOGBUFFER - table->logLength, format, args);
+	va_end(args);
+	if (len < 0 || (size_t) len < LOGBUFFER - table->logLength) {
+		table->logLength += max(len, 0);
+		return;
 	}
+	// did not fit: write out what came before, then try again
+	flushLog(net, table);
+	va_start(args, format);
+	len = vsnprintf(table->log, LOGBUFFER, format, args);
+	va_end(args);
+	table->logLength = min(max(len, 0), LOGBUFFER - 1);
+}
 
-	// Reached destination router
-	struct router* dstRouter = malloc(NUMROUTERS * sizeof(struct router));
-	dstRouter = routerToTable(network, dst);
-	outputPacket(dstRouter, p, true);
-
-	return;
-
-	// while current router is not destination router
-		// get index of destination port
-		// use index to get outgoing port
-		// write to output timestamp, src node, dst node, arrival UDP port, and outgoing UDP port
-		// assign arrival port and forwarding port
-		// if outgoing port is same as current port (next router is dst router)
-			// break;
+/* nextDirty()
+ *
+ * Returns the first destination from on that table has marked dirty, or n
+ * if none is.
+ */
+int nextDirty(struct router *table, int from, int n)
+{
+	int k = from / 64;
+	unsigned long long word;
 
-	// at destination router...
-		// output data (message)
-		// output src and dst router
-		// output each arrival and outgoing port that isn't equal to 0
+	if (from >= n)
+		return n;
+	word = table->dirty[k] & (~0ULL << (from % 64));
+	while (word == 0) {
+		if (++k * 64 >= n)
+			return n;
+		word = table->dirty[k];
+	}
+	return min(k * 64 + __builtin_ctzll(word), n);
 }
 
-/* initializeOutputFiles()
+/* formatInt()
  *
- * Initializes the routing-outputX.txt files from the routing tables.
+ * Writes v in decimal at p, returning where it ends.
  */
-void initializeOutputFiles(struct router **network) {
-	char routerLetters[NUMROUTERS] = "ABCDEF";
-
-    	int tableIndex = 0, timeBufferSize = 64, writeBufferSize = 1024;
+char *formatInt(char *p, int v)
+{
+	char digits[12];
+	unsigned int u = v < 0 ? 0u - (unsigned int) v : (unsigned int) v;
+	int k = 0;
 
-    	char timeBuffer[timeBufferSize];
-		char writeBuffer[writeBufferSize];
+	if (v < 0)
+		*p++ = '-';
+	do {
+		digits[k++] = (char) ('0' + u % 10);
+		u /= 10;
+	} while (u != 0);
+	while (k > 0)
+		*p++ = digits[--k];
+	return p;
+}
 
-        for ( ; tableIndex < 6; tableIndex++ ) {
-        	char path[20];
-		snprintf(path, sizeof(path), "routing-output%c%s\0", routerLetters[tableIndex], ".txt");
+/* writeRow()
+ *
+ * Logs the row of a routing table for destination i, labelled name. Tables
+ * are logged a row at a time by the million, so the row is put together by
+ * hand rather than by printf.
+ */
+void writeRow(struct network *net, struct router *table, int i, int name)
+{
+	const char *label = routerName(net, name);
+	size_t len = strlen(label);
+	char *p;
 
-        	FILE *f = fopen(path, "w");
+	if (len + 40 >= LOGBUFFER) {
+		appendLog(net, table, "%s %i %i %i\n", label, table->costs[i],
+			table->outgoingPorts[i], table->destinationPorts[i]);
+		return;
+	}
+	if (table->log == NULL && (table->log = malloc(LOGBUFFER)) == NULL)
+		error("Error allocating log");
+	if (table->logLength + len + 40 > LOGBUFFER)
+		flushLog(net, table);
+	p = table->log + table->logLength;
+	memcpy(p, label, len);
+	p += len;
+	*p++ = ' ';
+	p = formatInt(p, table->costs[i]);
+	*p++ = ' ';
+	p = formatInt(p, table->outgoingPorts[i]);
+	*p++ = ' ';
+	p = formatInt(p, table->destinationPorts[i]);
+	*p++ = '\n';
+	table->logLength = p - table->log;
+}
 
-        	if (f == NULL)
-            		error("Error opening file");
-        // Timestamp
-  //       time_t ltime;
-		// struct tm* timeinfo;
+/* writeTable()
+ *
+ * Writes the destination rows of a routing table: all of them if whole,
+ * otherwise just those its latest version changed, found among its dirty
+ * destinations.
+ */
+void writeTable(struct network *net, struct router *table, bool whole)
+{
+	int n = net->numRouters, i;
 
-		// time(&ltime);
-		// timeinfo = localtime(&ltime);
+	if (whole) {
+		for (i = 0; i < n; i++)
+			writeRow(net, table, i, table->otherRouters[i]);
+		return;
+	}
+	for (i = nextDirty(table, 0, n); i < n; i = nextDirty(table, i + 1, n)) {
+		// rows out of order need naming even when unreachable
+		if (table->changedAt[i] == table->version)
+			writeRow(net, table, i, i);
+	}
+}
 
-  //       	snprintf(timeBuffer, timeBufferSize, "%ld", timeinfo);
-            	char *t = getTime();
+/* outputTable()
+ *
+ * Logs the routing table: the rows that changed, or the whole table once
+ * stable, when the log is written out.
+ */
+void outputTable(struct network *net, struct router *table, bool isStable) {
+	if (!isStable) {
+	    char *t = getTime(net);
+	    appendLog(net, table, "\nTimestamp: %s\nDestination, Cost, Outgoing Port, Destination Port\n", t);
+	} else {
+		appendLog(net, table, "\nTable in Stable State\nDestination, Cost, Outgoing Port, Destination Port\n");
+	}
 
-        	fprintf(f, "Timestamp: %s\nDestination, Cost, Outgoing Port, Destination Port\n", t);
-        	int i;
-        	for (i=0; i<NUMROUTERS; i++) {
-            		fprintf(f, "%c %i %i %i\n",
-                		network[tableIndex]->otherRouters[i],
-                		network[tableIndex]->costs[i],
-                		network[tableIndex]->outgoingPorts[i],
-                		network[tableIndex]->destinationPorts[i]);
-            	}
-        	fclose(f);
-        }
-        return;
+	writeTable(net, table, isStable);
+	if (isStable)
+		flushLog(net, table);
+    return;
 }
 
-/* reinitalizeTopologyFile
+/* routerToPort()
  *
+ * Returns the Router PORTNO given the router id
+ */
+int routerToPort(struct network *net, int r) {
+	return net->topo.ports[r];
+}
+
+/* compareNeighbors()
  *
+ * Orders adjacency entries by neighbor id, cheapest link first.
  */
-void reinitializeTopologyFile(char killedRouter, int n)
+int compareNeighbors(const void *a, const void *b)
 {
-	// read lines from topology file
-	// if any line has the killed router in it, make the link cost INT_MAX
+	const int *x = a, *y = b;
+	if (x[0] != y[0])
+		return x[0] < y[0] ? -1 : 1;
+	return x[1] < y[1] ? -1 : x[1] > y[1];
+}
 
-	FILE *f = fopen("sample.txt", "r");
-	if (f == NULL)
-		error("Error opening sample file");
+/* buildAdjacency()
+ *
+ * Builds the CSR neighbor index from the live links in the topology. Links
+ * to or from killed routers and links at or above the infinity metric are
+ * left out, and duplicate links
+ * keep the cheapest cost.
+ */
+void buildAdjacency(struct network *net)
+{
+	struct adjacency *adj = &net->adj;
+	int n = net->numRouters;
+	int m = net->topo.numLinks;
+	int *pairs = malloc(2 * max(m, 1) * sizeof(int));
+	int *fill = adj->offsets;
+	int i, e, out;
 
-	char line[32];
-	char writebuf[512];
-	int canary = 0;
-	int linecount = 1;
-	bool changeCost = false;
+	if (pairs == NULL)
+		error("Error allocating adjacency");
 
-	while (fgets(line, 32, f) != NULL) {
-		char *ptr = strtok(line, ",");
+	memset(adj->offsets, 0, (n + 1) * sizeof(int));
+	for (i=0; i<m; i++) {
+		struct link *l = &net->topo.links[i];
+		if (net->killed[l->src] || net->killed[l->dst] || l->cost >= net->infinity || l->src == l->dst)
+			continue;
+		adj->offsets[l->src + 1]++;
+	}
+	for (i=0; i<n; i++)
+		adj->offsets[i + 1] += adj->offsets[i];
 
-		if (ptr[0] == killedRouter) {
-			changeCost = true;
-			// change the path cost on this one
-		}
+	// scatter (neighbor, cost) pairs into each row, using offsets[i] as the cursor
+	for (i=0; i<m; i++) {
+		struct link *l = &net->topo.links[i];
+		if (net->killed[l->src] || net->killed[l->dst] || l->cost >= net->infinity || l->src == l->dst)
+			continue;
+		e = fill[l->src]++;
+		pairs[2 * e] = l->dst;
+		pairs[2 * e + 1] = l->cost;
+	}
+	// the cursors now hold each row's end, so shift them back into place
+	for (i=n; i>0; i--)
+		adj->offsets[i] = adj->offsets[i - 1];
+	adj->offsets[0] = 0;
 
-		char *ptr2 = strtok(NULL, ",");
+	out = 0;
+	for (i=0; i<n; i++) {
+		int begin = adj->offsets[i], end = adj->offsets[i + 1];
+		qsort(pairs + 2 * begin, end - begin, 2 * sizeof(int), compareNeighbors);
 
-		if (ptr2[0] == killedRouter) {
-			changeCost = true;
-			// change the path cost on this one
+		adj->offsets[i] = out;
+		for (e = begin; e < end; e++) {
+			if (e > begin && pairs[2 * e] == pairs[2 * (e - 1)])
+				continue;
+			adj->neighbors[out] = pairs[2 * e];
+			adj->costs[out] = pairs[2 * e + 1];
+			adj->sentVersion[out] = 0;
+			out++;
 		}
-	
-		char *ptrOP = strtok(NULL, ",");
-		char *ptrCost = strtok(NULL, "\n");
+	}
+	adj->offsets[n] = out;
+	free(pairs);
+}
 
-		if (canary == 0)
-		{
-			strcpy(writebuf, ptr);
-			canary++;
-		}
-		else
-		{
-			strcat(writebuf, ptr);
-		}
+/* linkCost()
+ *
+ * Returns the cost of router i's direct link to router j, or INT_MAX if j is
+ * not a neighbor of i.
+ */
+int linkCost(struct network *net, int i, int j)
+{
+	int lo = net->adj.offsets[i], hi = net->adj.offsets[i + 1] - 1;
 
-		strcat(writebuf, ",");
-		strcat(writebuf, ptr2);
-		strcat(writebuf, ",");
-		strcat(writebuf, ptrOP);
-		strcat(writebuf, ",");
-		strcat(writebuf, (changeCost ? "2147683647"/*"1000000"*/ : ptrCost));
-		// if not end of file)
-		if (linecount != 18) // number of lines in network topo file
-		{
-			strcat(writebuf, "\n");
-		}
-		changeCost = false;
-		linecount++;
+	if (i == j)
+		return 0;
+	while (lo <= hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (net->adj.neighbors[mid] == j)
+			return net->adj.costs[mid];
+		if (net->adj.neighbors[mid] < j)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
 	}
-	fclose(f);
-	f = fopen("sample.txt", "w+");
+	return INT_MAX;
+}
 
-	// overwrite the file with the new write buffer contents
-	fprintf(f, "%s", writebuf);
-	fclose(f);
+/* addCost()
+ *
+ * Adds a link cost to a path cost, saturating at INT_MAX so an unreachable
+ * route never wraps around into a cheap one.
+ */
+int addCost(int cost, int link) {
+	if (cost == INT_MAX || link == INT_MAX || cost > INT_MAX - link)
+		return INT_MAX;
+	return cost + link;
 }
 
-void reinitializeTables(struct router *tableA, struct router *tableB, struct router *tableC, struct router *tableD, struct router *tableE, struct router *tableF) {
-	int a;
-	struct router *rp;
-	int ind, val;
-	for (a = 0; a < NUMROUTERS; a++)
-	{		
-		tableA->otherRouters[a] = NULL;
-		tableB->otherRouters[a] = NULL;
-		tableC->otherRouters[a] = NULL;
-		tableD->otherRouters[a] = NULL;
-		tableE->otherRouters[a] = NULL;
-		tableF->otherRouters[a] = NULL;
-
-		tableA->costs[a] = INT_MAX;
-		tableB->costs[a] = INT_MAX;
-		tableC->costs[a] = INT_MAX;
-		tableD->costs[a] = INT_MAX;
-		tableE->costs[a] = INT_MAX;
-		tableF->costs[a] = INT_MAX;
-
-		tableA->destinationPorts[a] = NULL;
-		tableB->destinationPorts[a] = NULL;
-		tableC->destinationPorts[a] = NULL;
-		tableD->destinationPorts[a] = NULL;
-		tableE->destinationPorts[a] = NULL;
-		tableF->destinationPorts[a] = NULL;
-
-		tableA->outgoingPorts[a] = NULL;
-		tableB->outgoingPorts[a] = NULL;
-		tableC->outgoingPorts[a] = NULL;
-		tableD->outgoingPorts[a] = NULL;
-		tableE->outgoingPorts[a] = NULL;
-		tableF->outgoingPorts[a] = NULL;
-
-		switch (a)
-		{
-			
-			case 0:
-				rp = tableA;	
-				ind = INDEXA;
-				val = ROUTERA;
-				break;
-			case 1:
-				rp = tableB;
-				ind = INDEXB;
-				val = ROUTERB;
-				break;
-			case 2:
-				rp = tableC;
-				ind = INDEXC;
-				val = ROUTERC;
-				break;
-			case 3:
-				rp = tableD;
-				ind = INDEXD;
-				val = ROUTERD;
-				break;
-			case 4:
-				rp = tableE;
-				ind = INDEXE;
-				val = ROUTERE;
-				break;
-			case 5:
-				rp = tableF;
-				ind = INDEXF;
-				val = ROUTERF;
-				break;
-		}
-		rp->index = ind;
-		rp->otherRouters[a] = (char) ('A' + a);
-		rp->costs[a] = 0;
-		rp->destinationPorts[a] = val;
-		rp->outgoingPorts[a] = val;
+/* setRoute()
+ *
+ * Routes table to dest through nextHop at cost, or marks dest unreachable if
+ * cost is INT_MAX, and stamps dest with the table's current version.
+ */
+void setRoute(struct network *net, struct router *table, int dest, int cost, int nextHop) {
+	if (cost == INT_MAX) {
+		table->otherRouters[dest] = -1;
+		table->outgoingPorts[dest] = 0;
+		table->destinationPorts[dest] = 0;
+		nextHop = -1;
+	} else {
+		table->otherRouters[dest] = dest;
+		table->outgoingPorts[dest] = routerToPort(net, nextHop);
+		table->destinationPorts[dest] = routerToPort(net, dest);
 	}
+	table->costs[dest] = cost;
+	table->feasibleCosts[dest] = min(table->feasibleCosts[dest], cost);
+	table->nextHop[dest] = nextHop;
+	table->fib[dest].nextHop = nextHop;
+	table->fib[dest].port = table->outgoingPorts[dest];
+	table->changedAt[dest] = table->version;
+	table->dirty[dest / 64] |= 1ULL << (dest % 64);
 }
 
-/* initializeFromFile()
+/* updateTable()
+ *
+ * Updates table if possible. isChanged says whether DVs from other senders
+ * in the same drain changed it already, in which case those changes and
+ * these share a version, to be logged together. Returns whether the table
+ * has changed in this drain.
  *
- * Initializes the routing tables from the information in 'sample.txt'.
+ * A cheaper path through any neighbor is taken, and a route through the
+ * sender follows whatever the sender now reports, worse or unreachable
+ * included, so a lost route is withdrawn hop by hop down the paths that used
+ * it. Costs at or above the infinity metric are unreachable.
+ *
+ * A new neighbor is only taken if it reports less than the lowest cost we had
+ * since the last full exchange, which it cannot do through us. That keeps a
+ * periodic update racing a withdrawal from feeding the withdrawn route back
+ * into a loop; other alternatives wait for the next full exchange.
  */
-struct matrix initializeFromFile(struct router *tableA, struct router *tableB, struct router *tableC, struct router *tableD, struct router *tableE, struct router *tableF, int killedRouters[]) {
-	FILE *f = fopen("sample.txt", "r");
-	if (f == NULL)
-		error("Error opening sample file");
+bool updateTable(struct network *net, struct router *currTable, struct distanceVector *rcvd, bool isChanged) {
+	int sender = rcvd->sender;
+	int link = linkCost(net, currTable->index, sender);
+	int k;
 
-	int numNeighbors[NUMROUTERS] = {0};
-
-	struct matrix neighborMatrix;
-	memset(neighborMatrix.r, -1, sizeof(int) * NUMROUTERS * NUMROUTERS);
-
-	char line[32];
-	while (fgets(line, 32, f) != NULL) {
-		char *ptr = strtok(line, ",");
-		// printf("%s %s killed!\n", ptr, killedRouters[0] ? "is" : "is not");
-		if (strcmp(ptr, "A") == 0 && !killedRouters[0]) {// and 'A' is not killed
-			ptr = strtok(NULL, ",");
-			char *ptrOP = strtok(NULL, ",");
-			char *ptrCost = strtok(NULL, ",");
-
-			// if ptrCost == INT_MAX
-			//	
-			// if ptr is killed, dont update the table
-			//printf("%s %s killed!\n", ptr, killedRouters[ptr[0] - 'A'] ? "is" : "is not");
-			if (!killedRouters[ptr[0] - 'A'])
-			{
-				switch (atoi(ptrOP)) {
-					case 10001:
-						tableA->otherRouters[atoi(ptrOP)-10000] = 'B';
-						numNeighbors[0]++;
-						break;
-					case 10002:
-						tableA->otherRouters[atoi(ptrOP)-10000] = 'C';
-						numNeighbors[0]++;
-						break;
-					case 10003:
-						tableA->otherRouters[atoi(ptrOP)-10000] = 'D';
-						numNeighbors[0]++;
-						break;
-					case 10004:
-						tableA->otherRouters[atoi(ptrOP)-10000] = 'E';
-						numNeighbors[0]++;
-						break;
-					case 10005:
-						tableA->otherRouters[atoi(ptrOP)-10000] = 'F';
-						numNeighbors[0]++;
-						break;
-				}
-				tableA->costs[atoi(ptrOP)-10000] = atoi(ptrCost);
-				tableA->outgoingPorts[atoi(ptrOP)-10000] = ROUTERA;
-				tableA->destinationPorts[atoi(ptrOP)-10000] = atoi(ptrOP);
-			}
-		} else if (strcmp(ptr, "B") == 0 && !killedRouters[1]) {
-			ptr = strtok(NULL, ",");
-			char *ptrOP = strtok(NULL, ",");
-			char *ptrCost = strtok(NULL, ",");
-			// printf("\n\n%s\n\n", ptrCost);
-			if (!killedRouters[ptr[0] - 'A'])
-			{
-				switch (atoi(ptrOP)) {
-					case 10000:
-						tableB->otherRouters[atoi(ptrOP)-10000] = 'A';
-						numNeighbors[1]++;
-						break;
-					case 10002:
-						tableB->otherRouters[atoi(ptrOP)-10000] = 'C';
-						numNeighbors[1]++;
-						break;
-					case 10003:
-						tableB->otherRouters[atoi(ptrOP)-10000] = 'D';
-						numNeighbors[1]++;
-						break;
-					case 10004:
-						tableB->otherRouters[atoi(ptrOP)-10000] = 'E';
-						numNeighbors[1]++;
-						break;
-					case 10005:
-						tableB->otherRouters[atoi(ptrOP)-10000] = 'F';
-						numNeighbors[1]++;
-						break;
-				}
-				tableB->costs[atoi(ptrOP)-10000] = atoi(ptrCost);
-				tableB->outgoingPorts[atoi(ptrOP)-10000] = ROUTERB;
-				tableB->destinationPorts[atoi(ptrOP)-10000] = atoi(ptrOP);		
-			}
-		} else if (strcmp(ptr, "C") == 0 && !killedRouters[2]) {
-			ptr = strtok(NULL, ",");
-			char *ptrOP = strtok(NULL, ",");
-			char *ptrCost = strtok(NULL, ",");
-			if (!killedRouters[ptr[0] - 'A'])
-			{
-				switch (atoi(ptrOP)) {
-					case 10000:
-						tableC->otherRouters[atoi(ptrOP)-10000] = 'A';
-						numNeighbors[2]++;
-						break;
-					case 10001:
-						tableC->otherRouters[atoi(ptrOP)-10000] = 'B';
-						numNeighbors[2]++;
-						break;
-					case 10003:
-						tableC->otherRouters[atoi(ptrOP)-10000] = 'D';
-						numNeighbors[2]++;
-						break;
-					case 10004:
-						tableC->otherRouters[atoi(ptrOP)-10000] = 'E';
-						numNeighbors[2]++;
-						break;
-					case 10005:
-						tableC->otherRouters[atoi(ptrOP)-10000] = 'F';
-						numNeighbors[2]++;
-						break;
-				}
-				tableC->costs[atoi(ptrOP)-10000] = atoi(ptrCost);
-				tableC->outgoingPorts[atoi(ptrOP)-10000] = ROUTERC;
-				tableC->destinationPorts[atoi(ptrOP)-10000] = atoi(ptrOP);
-			}
-		} else if (strcmp(ptr, "D") == 0 && !killedRouters[3]) {
-			ptr = strtok(NULL, ",");
-			char *ptrOP = strtok(NULL, ",");
-			char *ptrCost = strtok(NULL, ",");
-			if (!killedRouters[ptr[0] - 'A'])
-			{
-				switch (atoi(ptrOP)) {
-					case 10000:
-						tableD->otherRouters[atoi(ptrOP)-10000] = 'A';
-						numNeighbors[3]++;
-						break;
-					case 10001:
-						tableD->otherRouters[atoi(ptrOP)-10000] = 'B';
-						numNeighbors[3]++;
-						break;
-					case 10002:
-						tableD->otherRouters[atoi(ptrOP)-10000] = 'C';
-						numNeighbors[3]++;
-						break;
-					case 10004:
-						tableD->otherRouters[atoi(ptrOP)-10000] = 'E';
-						numNeighbors[3]++;
-						break;
-					case 10005:
-						tableD->otherRouters[atoi(ptrOP)-10000] = 'F';
-						numNeighbors[3]++;
-						break;
-				}
-				tableD->costs[atoi(ptrOP)-10000] = atoi(ptrCost);
-				tableD->outgoingPorts[atoi(ptrOP)-10000] = ROUTERD;
-				tableD->destinationPorts[atoi(ptrOP)-10000] = atoi(ptrOP);
-			}
-		} else if (strcmp(ptr, "E") == 0 && !killedRouters[4]) {
-			ptr = strtok(NULL, ",");
-			char *ptrOP = strtok(NULL, ",");
-			char *ptrCost = strtok(NULL, ",");
-			if (!killedRouters[ptr[0] - 'A'])
-			{
-				switch (atoi(ptrOP)) {
-					case 10000:
-						tableE->otherRouters[atoi(ptrOP)-10000] = 'A';
-						numNeighbors[4]++;
-						break;
-					case 10001:
-						tableE->otherRouters[atoi(ptrOP)-10000] = 'B';
-						numNeighbors[4]++;
-						break;
-					case 10002:
-						tableE->otherRouters[atoi(ptrOP)-10000] = 'C';
-						numNeighbors[4]++;
-						break;
-					case 10003:
-						tableE->otherRouters[atoi(ptrOP)-10000] = 'D';
-						numNeighbors[4]++;
-						break;
-					case 10005:
-						tableE->otherRouters[atoi(ptrOP)-10000] = 'F';
-						numNeighbors[4]++;
-						break;
-				}
-				tableE->costs[atoi(ptrOP)-10000] = atoi(ptrCost);
-				tableE->outgoingPorts[atoi(ptrOP)-10000] = ROUTERE;
-				tableE->destinationPorts[atoi(ptrOP)-10000] = atoi(ptrOP);
-			}
-		} else if (strcmp(ptr, "F") == 0 && !killedRouters[5]) {
-			ptr = strtok(NULL, ",");
-			char *ptrOP = strtok(NULL, ",");
-			char *ptrCost = strtok(NULL, ",");
-			if (!killedRouters[ptr[0] - 'A'])
-			{
-				switch (atoi(ptrOP)) {
-					case 10000:
-						tableF->otherRouters[atoi(ptrOP)-10000] = 'A';
-						numNeighbors[5]++;
-						break;
-					case 10001:
-						tableF->otherRouters[atoi(ptrOP)-10000] = 'B';
-						numNeighbors[5]++;
-						break;
-					case 10002:
-						tableF->otherRouters[atoi(ptrOP)-10000] = 'C';
-						numNeighbors[5]++;
-						break;
-					case 10003:
-						tableF->otherRouters[atoi(ptrOP)-10000] = 'D';
-						numNeighbors[5]++;
-						break;
-					case 10004:
-						tableF->otherRouters[atoi(ptrOP)-10000] = 'E';
-						numNeighbors[5]++;
-						break;
-				}
-				tableF->costs[atoi(ptrOP)-10000] = atoi(ptrCost);
-				tableF->outgoingPorts[atoi(ptrOP)-10000] = ROUTERF;
-				tableF->destinationPorts[atoi(ptrOP)-10000] = atoi(ptrOP);
-			}
-		}
-	}
+	// DVs from routers we have no live link to carry nothing usable
+	if (link == INT_MAX)
+		return isChanged;
 
-	int index=0;
-	int i;
-	for (i=0; i<NUMROUTERS; i++) {
-		if (tableA->costs[i] != INT_MAX && tableA->costs[i] != 0) {
-			neighborMatrix.r[0][index] = i;
-			index++;
-		}
-	}
-	index=0;
-	i = 0;
-	for (; i<NUMROUTERS; i++) {
-		if (tableB->costs[i] != INT_MAX && tableB->costs[i] != 0) {
-			neighborMatrix.r[1][index] = i;
-			index++;
-		}
-	}
-	i = 0;
-	index=0;
-	for (; i<NUMROUTERS; i++) {
-		if (tableC->costs[i] != INT_MAX && tableC->costs[i] != 0) {
-			neighborMatrix.r[2][index] = i;
-			index++;
-		}
-	}
-	index=0;
-	i = 0;
-	for (; i<NUMROUTERS; i++) {
-		if (tableD->costs[i] != INT_MAX && tableD->costs[i] != 0) {
-			neighborMatrix.r[3][index] = i;
-			index++;
-		}
-	}
-	i = 0;
-	index=0;
-	for (; i<NUMROUTERS; i++) {
-		if (tableE->costs[i] != INT_MAX && tableE->costs[i] != 0) {
-			neighborMatrix.r[4][index] = i;
-			index++;
-		}
-	}
-	index=0;
-	i = 0;
-	for (; i<NUMROUTERS; i++) {
-		if (tableF->costs[i] != INT_MAX && tableF->costs[i] != 0) {
-			neighborMatrix.r[5][index] = i;
-			index++;
+	for (k=0; k<rcvd->count; k++) {
+		int i = rcvd->dests[k];
+		// ignore own entry in table
+		if (i == currTable->index)
+			continue;
+
+		int cost = addCost(rcvd->costs[k], link);
+		if (cost >= net->infinity)
+			cost = INT_MAX;
+
+		if (currTable->nextHop[i] == sender ? cost != currTable->costs[i]
+				: cost < currTable->costs[i] && rcvd->costs[k] < currTable->feasibleCosts[i]) {
+			if (!isChanged)
+				currTable->version++;
+			setRoute(net, currTable, i, cost, sender);
+			isChanged = true;
 		}
 	}
-	
-	return neighborMatrix;
+	return isChanged;
 }
 
-int main(int argc, char *argv[])
-{
-	int sockfd[NUMROUTERS]; /* socket */
-	int clientlen; /* byte size of client's address */
-	struct sockaddr_in serveraddr[NUMROUTERS]; /* server's address */
-	struct sockaddr_in clientaddr; /* client's address */
-	struct hostent *hostp; /* client host info */
-	int buf[BUFSIZE]; /* message buffer */
-	char *hostaddrp; /* dotted decimal host address string */
-	int optval; /* flag value for setsockopt */
-	int n; /* message byte size */
-	int count;
-	fd_set socks;
-	bool stableState = false;
-	int nKills = 0;
-    char * filepath = "sample.txt";
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = 50000;
-	int killedRouters[NUMROUTERS] = {0};
-
-	/* for testing */
-	struct router tableA, tableB, tableC, tableD, tableE, tableF;
-/*
-	struct router tableA = {
-		INDEXA,
-		{   'A',     NULL,    NULL,    NULL,    NULL,    NULL   },
-		{    0,     INT_MAX, INT_MAX, INT_MAX, INT_MAX, INT_MAX },
-		{ ROUTERA,   NULL,    NULL,    NULL,    NULL,    NULL   },
-		{ ROUTERA,   NULL,    NULL,    NULL,    NULL,    NULL   }
-	};
-*/
-/*
-	struct router tableA = {
-		INDEXA,
-        	{   'A',     NULL,    NULL,    NULL,    NULL,    NULL   },
-        	{    0,     INT_MAX, INT_MAX, INT_MAX, INT_MAX, INT_MAX },
-        	{ ROUTERA,   NULL,    NULL,    NULL,    NULL,    NULL   },
-        	{ ROUTERA,   NULL,    NULL,    NULL,    NULL,    NULL   }
-	};
-
-
-	struct router tableB = {
-		INDEXB,
-		{  NULL,     'B',    NULL,    NULL,    NULL,    NULL    },
-		{ INT_MAX,    0,    INT_MAX, INT_MAX, INT_MAX, INT_MAX  },
-		{  NULL,   ROUTERB,   NULL,    NULL,    NULL,    NULL   },
-		{  NULL,   ROUTERB,   NULL,    NULL,    NULL,    NULL   }
-	};
-	struct router tableC = {
-		INDEXC,
-		{  NULL,     NULL,     'C',      NULL,    NULL,    NULL   },
-		{ INT_MAX, INT_MAX,     0,     INT_MAX, INT_MAX, INT_MAX  },
-		{  NULL,     NULL,   ROUTERC,    NULL,    NULL,    NULL   },
-		{  NULL,     NULL,   ROUTERC,    NULL,    NULL,    NULL   }
-	};
-	struct router tableD = {
-		INDEXD,
-		{  NULL,     NULL,    NULL,    'D',     NULL,    NULL    },
-		{ INT_MAX, INT_MAX, INT_MAX,    0,    INT_MAX, INT_MAX   },
-		{  NULL,     NULL,    NULL,  ROUTERD,    NULL,    NULL   },
-		{  NULL,     NULL,    NULL,  ROUTERD,    NULL,    NULL   }
-	};
-	struct router tableE = {
-		INDEXE,
-		{  NULL,     NULL,    NULL,    NULL,    'E',    NULL     },
-		{ INT_MAX, INT_MAX, INT_MAX, INT_MAX,    0,    INT_MAX   },
-		{  NULL,     NULL,    NULL,    NULL,  ROUTERE,    NULL   },
-		{  NULL,     NULL,    NULL,    NULL,  ROUTERE,    NULL   }
-	};
-	struct router tableF = {
-		INDEXF,
-		{  NULL,     NULL,    NULL,    NULL,    NULL,     'F'   },
-		{ INT_MAX, INT_MAX, INT_MAX, INT_MAX, INT_MAX,    0     },
-		{  NULL,     NULL,    NULL,    NULL,    NULL,  ROUTERF  },
-		{  NULL,     NULL,    NULL,    NULL,    NULL,  ROUTERF  }
-	};
-*/
-	struct router **network = malloc(NUMROUTERS * sizeof(struct router*));
-	int i;
-	for (i=0; i<NUMROUTERS; i++) {
-		network[i] = malloc(NUMROUTERS * sizeof(struct router));
-	}
-	network[0] = &tableA;
-	network[1] = &tableB;
-	network[2] = &tableC;
-	network[3] = &tableD;
-	network[4] = &tableE;
-	network[5] = &tableF;
-/*
-	for(i=0;i < NUMROUTERS; i++)
-	{
-		printRouter(network[i]);
-	}
-*/
-re_initialize:
-/*
-	if (nKills > 0)
-	{
-		printf("\nenter\n");
-	}
-*/
-	reinitializeTables(&tableA, &tableB, &tableC, &tableD, &tableE, &tableF);
-/*
-	printf("***\n***AFTER REINIT:***\n***");	
-	for(i=0;i < NUMROUTERS; i++)
-	{
-		printRouter(network[i]);
+/* outputPacket()
+ *
+ * Writes packet info to the router output file
+ */
+void outputPacket(struct network *net, struct router *table, struct packet *p, bool isDestination) {
+	// write to output timestamp, src node, dst node, arrival UDP port, and outgoing UDP port
+	char *t = getTime(net);
+	if (!isDestination) {
+		appendLog(net, table, "\nReceived data packet:\nTimestamp: %s\nSource Node: %s\nDestination Node: %s\nArrival UDP Port: %i\nOutgoing UDP Port: %i\n", t, routerName(net, p->srcNode), routerName(net, p->dstNode), routerToPort(net, table->index), p->forwardingPort);
+	} else {
+		appendLog(net, table, "\nCumulative information about data packet:\nTimestamp: %s\nMessage: %s\nSource Node: %s\nDestination Node: %s\nArrival (Destination) UDP Port: %i\n", t, p->message, routerName(net, p->srcNode), routerName(net, p->dstNode), routerToPort(net, p->dstNode));
 	}
-*/
-	struct matrix neighborMatrix = initializeFromFile(&tableA, &tableB, &tableC, &tableD, &tableE, &tableF, killedRouters);	
-	/* end testing */
-/*
-	printf("***\n***SECOND PRINT:***\n***");	
+	flushLog(net, table);
+}
 
-	for(i=0;i < NUMROUTERS; i++)
-	{
-		printRouter(network[i]);
-	}
+/* outputDrop()
+ *
+ * Writes to the router output file that the router dropped the packet, and
+ * why.
+ */
+void outputDrop(struct network *net, struct router *table, struct packet *p, const char *reason) {
+	appendLog(net, table, "\nDropped data packet:\nTimestamp: %s\nSource Node: %s\nDestination Node: %s\nArrival UDP Port: %i\nReason: %s\n", getTime(net), routerName(net, p->srcNode), routerName(net, p->dstNode), routerToPort(net, table->index), reason);
+	flushLog(net, table);
+}
 
-	int g;
-	for (i=0; i < NUMROUTERS; i++)
-	{
-		for (g=0; g < NUMROUTERS; g++)
-			printf("%d\t", neighborMatrix.r[i][g]);	
-		printf("\n");
-	}
-*/
-	initializeOutputFiles(network);
-	for (i=0; i<NUMROUTERS; i++) {
-		/* create parent socket */
-		if ( (sockfd[i] = socket(AF_INET, SOCK_DGRAM, 0)) < 0 )
-			error("Error opening socket");
+/* routerToTable()
+ *
+ * Returns the DV given the router id
+ */
+struct router* routerToTable(struct network *net, int r) {
+	return &net->routers[r];
+}
 
-		/* server can be rerun immediately after killed */
-		optval = 1;
-		setsockopt(sockfd[i], SOL_SOCKET, SO_REUSEADDR, (const void *)&optval, sizeof(int));
-		setsockopt(sockfd[i], SOL_SOCKET, SO_RCVTIMEO, (char *)&tv, sizeof(struct timeval));
+/* forwardPacket()
+ *
+ * Forwards a packet from the source to destination, each hop looking its
+ * next router up in its FIB. A router with no route, or a packet that has
+ * gone round a loop, drops it there. Returns whether it arrived.
+ */
+bool forwardPacket(struct packet *p, struct network *net) {
+	int src = p->srcNode;
+	int dst = p->dstNode;
+	int hops = 0;
 
-		/* build server's Internet address */
-		bzero((char *) &serveraddr[i], sizeof(serveraddr[i]));
-		serveraddr[i].sin_family = AF_INET;
-		serveraddr[i].sin_addr.s_addr = htonl(INADDR_ANY);
+	struct fibEntry hop;
 
-		switch(i+10000) {
-			case ROUTERA:
-				serveraddr[i].sin_port = htons(ROUTERA);
-				break;
-			case ROUTERB:
-				serveraddr[i].sin_port = htons(ROUTERB);
-				break;
-			case ROUTERC:
-				serveraddr[i].sin_port = htons(ROUTERC);
-				break;
-			case ROUTERD:
-				serveraddr[i].sin_port = htons(ROUTERD);
-				break;
-			case ROUTERE:
-				serveraddr[i].sin_port = htons(ROUTERE);
-				break;
-			case ROUTERF:
-				serveraddr[i].sin_port = htons(ROUTERF);
-				break;
+	struct router* curr = routerToTable(net, src);
+	p->arrivalPort = routerToPort(net, curr->index);
+	while (curr->index != dst) {
+		// ports need not be unique across hosts, so follow next hops by id
+		hop = curr->fib[dst];
+		if (hop.nextHop < 0) {
+			outputDrop(net, curr, p, "destination unreachable");
+			return false;
 		}
-		/* bind: associate parent socket with port */
-		if (bind(sockfd[i], (struct sockaddr *) &serveraddr[i], sizeof(serveraddr[i])) < 0)
-			error("Error on binding");
+		if (hops++ > net->numRouters) {
+			outputDrop(net, curr, p, "hop limit exceeded");
+			return false;
+		}
+		p->forwardingPort = hop.port;
+		outputPacket(net, curr, p, false);
+		curr = routerToTable(net, hop.nextHop);
 	}
 
-	clientlen = sizeof(clientaddr);
-	int serverlen = sizeof(serveraddr[0]);
-	int start;
-	/* begin by having ROUTERA send DV to one neighbor */
-	/* for this implementation, ROUTERA will send to ROUTERB */
-	struct router* starter;
-	switch (argv[1][0])
-	{
-		case 'A':
-			starter = &tableA;
-			start = INDEXA;
-			break;
-		case 'B':
-			starter = &tableB;
-			start = INDEXB;
-			break;
-		case 'C':
-			starter = &tableC;
-			start = INDEXC;
-			break;
-		case 'D':
-			starter = &tableD;
-			start = INDEXD;
-			break;
-		case 'E':
-			starter = &tableE;
-			start = INDEXE;
-			break;
-		case 'F':
-			starter = &tableF;
-			start = INDEXF;
-			break;
-	}
-//exit(0);
+	// Reached destination router
+	outputPacket(net, curr, p, true);
+	return true;
+}
 
-/*
+/* initializeOutputFiles()
+ *
+ * Initializes the routing-outputX.txt files from the routing tables.
+ */
+void initializeOutputFiles(struct network *net) {
+	int tableIndex;
 
-	for (i=0; i<NUMROUTERS; i++) {
-		if (neighborMatrix.r[0][i] != -1) {
-			start = neighborMatrix.r[0][i];
-			break;
-		}
-	}
-*/
-// start is 0 thru 5
-	//in this case, start=1
-	//printRouter(starter);
-	memset(buf, 0, BUFSIZE);
-	tableToBuffer(starter, &buf);
-//	tableToBuffer(&tableA, &buf);
+        for (tableIndex = 0; tableIndex < net->numRouters; tableIndex++) {
+        	struct router *table = &net->routers[tableIndex];
 
-//	printf("Starting router: %d %c\n", start - 'A', start);
+            	char *t = getTime(net);
 
-//	n = sendto(sockfd[start - 'A'], buf, BUFSIZE*sizeof(int), 0, (struct sockaddr *)&serveraddr[start], clientlen);
-	n = sendto(sockfd[start], buf, BUFSIZE*sizeof(int), 0, (struct sockaddr *)&serveraddr[start], clientlen);
+        	fclose(openOutputFile(net, tableIndex, "w"));
+        	appendLog(net, table, "Timestamp: %s\nDestination, Cost, Outgoing Port, Destination Port\n", t);
+		writeTable(net, table, true);
+        	flushLog(net, table);
+        }
+        return;
+}
 
-	int nsocks = max(sockfd[0], sockfd[1]);
-	for (i=2; i<NUMROUTERS; i++) {
-		nsocks = max(nsocks, sockfd[i]);
+/* hashName()
+ *
+ * FNV-1a hash of a router name.
+ */
+unsigned int hashName(const char *name, size_t len)
+{
+	unsigned int h = 2166136261u;
+	size_t k;
+	for (k = 0; k < len; k++) {
+		h ^= (unsigned char) name[k];
+		h *= 16777619u;
 	}
-	int counterdd = 0;
-	count = 0;
-	printf("Stabilizing network...");
-	/* loop: wait for datagram, then echo it */
-	while (1) {
-		FD_ZERO(&socks);
-		for (i=0; i<NUMROUTERS; i++) {
-			FD_SET(sockfd[i], &socks);
-		}
-		
-		if (select(nsocks+1, &socks, NULL, NULL, NULL) < 0) {
-			printf("Error selecting socket\n");
-		} else {
-			/* receives UDP datagram from client */
-			memset(buf, 0, BUFSIZE);
-			if (FD_ISSET(sockfd[0], &socks)) {
-				if ( (n = recvfrom(sockfd[0], buf, BUFSIZE*sizeof(int), 0, (struct sockaddr *)&clientaddr, &clientlen)) < 0 )
-					error("Error receiving datagram from client\n");
+	return h;
+}
 
-				struct router compTable;
-				bufferToTable(buf, &compTable);
+/* lookupRouter()
+ *
+ * Returns the id of the router whose name is the len bytes at name, or -1.
+ * When slot is given it receives the map slot the name hashes to.
+ */
+int lookupRouter(struct topology *topo, const char *name, size_t len, unsigned int *slot)
+{
+	unsigned int s;
+	int id;
 
-				if (updateTable(&tableA, compTable) == false)
-					count++;
-				else
-					count = 0;
+	if (topo->mapSlots == NULL)
+		return -1;
+	for (s = hashName(name, len) & topo->mapMask; (id = topo->mapSlots[s]) >= 0; s = (s + 1) & topo->mapMask) {
+		if (memcmp(topo->names[id], name, len) == 0 && topo->names[id][len] == '\0')
+			break;
+	}
+	if (slot != NULL)
+		*slot = s;
+	return id;
+}
 
-				tableToBuffer(&tableA, &buf);
+/* findRouter()
+ *
+ * Returns the id of the named router in the topology, or -1.
+ */
+int findRouter(struct topology *topo, const char *name)
+{
+	return lookupRouter(topo, name, strlen(name), NULL);
+}
 
-				for (i=0; i<NUMROUTERS; i++) {
-					if (neighborMatrix.r[0][i] != -1) {
-						n = sendto(sockfd[0], buf, BUFSIZE*sizeof(int), 0, (struct sockaddr *)&serveraddr[neighborMatrix.r[0][i]], clientlen);
-						if (n < 0)
-							error("Error sending to client");
-					}
-				}
-			}
+/* rehashRouters()
+ *
+ * Rebuilds the name map with room for at least the given number of routers,
+ * keeping it at most half full.
+ */
+void rehashRouters(struct topology *topo, int capacity)
+{
+	unsigned int size = 16, s;
+	int id;
 
-			if (FD_ISSET(sockfd[1], &socks)) {
-				if ( (n = recvfrom(sockfd[1], buf, BUFSIZE*sizeof(int), 0, (struct sockaddr *)&clientaddr, &clientlen)) < 0 )
-				{
-					error("Error receiving datagram from client\n");
-					printf("error\n");
-				}
+	while (size < 2 * (unsigned int) capacity)
+		size *= 2;
+	free(topo->mapSlots);
+	topo->mapSlots = malloc(size * sizeof(int));
+	if (topo->mapSlots == NULL)
+		error("Error allocating topology");
+	memset(topo->mapSlots, -1, size * sizeof(int));
+	topo->mapMask = size - 1;
 
-				struct router compTable;
-				
-				bufferToTable(&buf, &compTable);
-				if (updateTable(&tableB, compTable) == false)
-					count++;
-				else
-					count = 0;
+	for (id = 0; id < topo->numRouters; id++) {
+		lookupRouter(topo, topo->names[id], strlen(topo->names[id]), &s);
+		topo->mapSlots[s] = id;
+	}
+}
 
-				tableToBuffer(&tableB, &buf);
+/* internRouter()
+ *
+ * Returns the dense id of the router whose name is the len bytes at name,
+ * assigning the next free id the first time a name is seen.
+ */
+int internRouter(struct topology *topo, const char *name, size_t len, int *capacity)
+{
+	unsigned int slot;
+	int id = lookupRouter(topo, name, len, &slot);
+	if (id >= 0)
+		return id;
 
-				for (i=0; i<NUMROUTERS; i++) {
-					if (neighborMatrix.r[1][i] != -1) {
-						n = sendto(sockfd[1], buf, BUFSIZE*sizeof(int), 0, (struct sockaddr *)&serveraddr[neighborMatrix.r[1][i]], clientlen);
-						if (n < 0)
-							error("Error sending to client");
-					}
+	if (topo->numRouters == *capacity) {
+		*capacity = *capacity ? *capacity * 2 : 16;
+		topo->names = realloc(topo->names, *capacity * sizeof(char *));
+		topo->ports = realloc(topo->ports, *capacity * sizeof(int));
+		topo->hosts = realloc(topo->hosts, *capacity * sizeof(struct in6_addr));
+		if (topo->names == NULL || topo->ports == NULL || topo->hosts == NULL)
+			error("Error allocating topology");
+		rehashRouters(topo, *capacity);
+		lookupRouter(topo, name, len, &slot);
+	}
+	id = topo->numRouters++;
+	topo->names[id] = strndup(name, len);
+	if (topo->names[id] == NULL)
+		error("Error allocating topology");
+	topo->ports[id] = -1;
+	topo->mapSlots[slot] = id;
+	return id;
+}
+
+struct namedRouter
+{
+	const char *name;
+	int id;
+};
+
+int compareNames(const void *a, const void *b)
+{
+	return strcmp(((const struct namedRouter *) a)->name, ((const struct namedRouter *) b)->name);
+}
+
+/* sortRouters()
+ *
+ * Renumbers routers so that ids follow name order, which keeps tables and
+ * output files ordered A, B, C, ... regardless of the order of the file.
+ */
+void sortRouters(struct topology *topo)
+{
+	int n = topo->numRouters;
+	struct namedRouter *sorted = malloc(n * sizeof(struct namedRouter));
+	char **names = malloc(n * sizeof(char *));
+	int *ports = malloc(n * sizeof(int));
+	struct in6_addr *hosts = malloc(n * sizeof(struct in6_addr));
+	int *newId = malloc(n * sizeof(int));
+	int i;
+
+	if (sorted == NULL || names == NULL || ports == NULL || hosts == NULL || newId == NULL)
+		error("Error allocating topology");
+
+	for (i=0; i<n; i++) {
+		sorted[i].name = topo->names[i];
+		sorted[i].id = i;
+	}
+	qsort(sorted, n, sizeof(struct namedRouter), compareNames);
+	for (i=0; i<n; i++) {
+		newId[sorted[i].id] = i;
+		names[i] = topo->names[sorted[i].id];
+		ports[i] = topo->ports[sorted[i].id];
+		hosts[i] = topo->hosts[sorted[i].id];
+	}
+	for (i=0; i<topo->numLinks; i++) {
+		topo->links[i].src = newId[topo->links[i].src];
+		topo->links[i].dst = newId[topo->links[i].dst];
+	}
+
+	free(topo->names);
+	free(topo->ports);
+	free(topo->hosts);
+	free(sorted);
+	free(newId);
+	topo->names = names;
+	topo->ports = ports;
+	topo->hosts = hosts;
+	rehashRouters(topo, n);
+}
+
+/* topologyError()
+ *
+ * Reports a malformed topology file, naming the offending line, and exits.
+ */
+void topologyError(const char *path, int line, const char *fmt, ...)
+{
+	va_list args;
+
+	fprintf(stderr, "%s:%d: ", path, line);
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+/* splitFields()
+ *
+ * Splits the line [pos, end) at commas into at most max fields with the
+ * surrounding blanks trimmed. Returns the number of fields, or -1 for a blank
+ * or comment line.
+ */
+int splitFields(const char *pos, const char *end, const char **fields, size_t *lens, int max)
+{
+	int count = 0;
+
+	while (pos < end && isspace((unsigned char) *pos))
+		pos++;
+	if (pos == end || *pos == '#')
+		return -1;
+
+	while (count < max) {
+		const char *comma = memchr(pos, ',', end - pos);
+		const char *stop = comma ? comma : end;
+		const char *last = stop;
+
+		while (pos < last && isspace((unsigned char) *pos))
+			pos++;
+		while (last > pos && isspace((unsigned char) last[-1]))
+			last--;
+		fields[count] = pos;
+		lens[count] = last - pos;
+		count++;
+
+		if (comma == NULL)
+			return count;
+		pos = comma + 1;
+	}
+	// more fields than expected
+	return max + 1;
+}
+
+/* parseNumber()
+ *
+ * Parses the len digits at s into *value, saturating at LLONG_MAX. Returns
+ * false if the field is empty or not a plain decimal number.
+ */
+bool parseNumber(const char *s, size_t len, long long *value)
+{
+	long long v = 0;
+	size_t k;
+
+	if (len == 0)
+		return false;
+	for (k = 0; k < len; k++) {
+		if (s[k] < '0' || s[k] > '9')
+			return false;
+		if (v <= (LLONG_MAX - 9) / 10)
+			v = v * 10 + (s[k] - '0');
+		else
+			v = LLONG_MAX;
+	}
+	*value = v;
+	return true;
+}
+
+/* parseAddress()
+ *
+ * Parses the len bytes at s, "port", "a.b.c.d:port" or "[v6]:port", into
+ * *port and host, with IPv4 mapped into IPv6 and :: for a bare port. Returns
+ * false if the field is malformed.
+ */
+bool parseAddress(const char *s, size_t len, struct in6_addr *host, long long *port)
+{
+	const char *colon = memrchr(s, ':', len);
+	char text[INET6_ADDRSTRLEN];
+	struct in_addr v4;
+	size_t hostLen;
+
+	memset(host, 0, sizeof(*host));
+	if (colon == NULL)
+		return parseNumber(s, len, port);
+	if (!parseNumber(colon + 1, s + len - colon - 1, port))
+		return false;
+
+	hostLen = colon - s;
+	if (hostLen >= 2 && s[0] == '[' && s[hostLen - 1] == ']') {
+		if (hostLen - 2 >= sizeof(text))
+			return false;
+		memcpy(text, s + 1, hostLen - 2);
+		text[hostLen - 2] = '\0';
+		return inet_pton(AF_INET6, text, host) == 1;
+	}
+	if (hostLen >= sizeof(text))
+		return false;
+	memcpy(text, s, hostLen);
+	text[hostLen] = '\0';
+	if (inet_pton(AF_INET, text, &v4) != 1)
+		return false;
+	host->s6_addr[10] = host->s6_addr[11] = 0xff;
+	memcpy(host->s6_addr + 12, &v4, sizeof(v4));
+	return true;
+}
+
+/* formatAddress()
+ *
+ * Writes router id's address into buf, ADDRESSSIZE bytes, the way the
+ * topology text gives it, and returns buf.
+ */
+char *formatAddress(struct topology *topo, int id, char *buf)
+{
+	const struct in6_addr *host = &topo->hosts[id];
+	char text[INET6_ADDRSTRLEN];
+
+	if (IN6_IS_ADDR_UNSPECIFIED(host)) {
+		snprintf(buf, ADDRESSSIZE, "%d", topo->ports[id]);
+	} else if (IN6_IS_ADDR_V4MAPPED(host)) {
+		inet_ntop(AF_INET, host->s6_addr + 12, text, sizeof(text));
+		snprintf(buf, ADDRESSSIZE, "%s:%d", text, topo->ports[id]);
+	} else {
+		inet_ntop(AF_INET6, host, text, sizeof(text));
+		snprintf(buf, ADDRESSSIZE, "[%s]:%d", text, topo->ports[id]);
+	}
+	return buf;
+}
+
+/* isIPv6()
+ *
+ * Returns true if router id listens on an IPv6 address, not IPv4.
+ */
+bool isIPv6(struct topology *topo, int id)
+{
+	return !IN6_IS_ADDR_UNSPECIFIED(&topo->hosts[id]) && !IN6_IS_ADDR_V4MAPPED(&topo->hosts[id]);
+}
+
+/* parseTopology()
+ *
+ * Parses topology text in a single pass, one "src,dst,dstAddress,cost" link
+ * per line, where the address is parseAddress()'s. Names may be any string
+ * without commas and are interned to dense ids as they are seen; blank lines
+ * and lines starting with '#' are skipped.
+ */
+void parseTopology(const char *path, const char *text, size_t size, struct topology *topo)
+{
+	const char *pos = text, *end = text + size;
+	int routerCapacity = 0, linkCapacity = 0, portCapacity = 0;
+	int *portLines = NULL;	/* line each router's address was first given on */
+	int line = 0;
+
+	while (pos < end) {
+		const char *eol = memchr(pos, '\n', end - pos);
+		const char *fields[4];
+		size_t lens[4];
+		struct in6_addr host;
+		long long port, cost;
+		char given[ADDRESSSIZE];
+		int count, src, dst;
+
+		if (eol == NULL)
+			eol = end;
+		line++;
+		count = splitFields(pos, eol, fields, lens, 4);
+		pos = eol + 1;
+		if (count < 0)
+			continue;
+
+		if (count != 4)
+			topologyError(path, line, "expected src,dst,port,cost but found %d field%s", count > 4 ? 5 : count, count == 1 ? "" : "s");
+		if (lens[0] == 0 || lens[1] == 0)
+			topologyError(path, line, "empty router name");
+		if (!parseAddress(fields[2], lens[2], &host, &port) || port < 1 || port > 65535)
+			topologyError(path, line, "bad address '%.*s'", (int) lens[2], fields[2]);
+		if (!parseNumber(fields[3], lens[3], &cost))
+			topologyError(path, line, "bad cost '%.*s'", (int) lens[3], fields[3]);
+
+		src = internRouter(topo, fields[0], lens[0], &routerCapacity);
+		dst = internRouter(topo, fields[1], lens[1], &routerCapacity);
+		if (src == dst)
+			topologyError(path, line, "router %s links to itself", topo->names[src]);
+
+		if (routerCapacity > portCapacity) {
+			portCapacity = routerCapacity;
+			portLines = realloc(portLines, portCapacity * sizeof(int));
+			if (portLines == NULL)
+				error("Error allocating topology");
+		}
+		if (topo->ports[dst] < 0) {
+			topo->ports[dst] = (int) port;
+			topo->hosts[dst] = host;
+			portLines[dst] = line;
+		} else if (topo->ports[dst] != port || memcmp(&topo->hosts[dst], &host, sizeof(host)) != 0) {
+			topologyError(path, line, "address %.*s for router %s conflicts with %s on line %d",
+					(int) lens[2], fields[2], topo->names[dst], formatAddress(topo, dst, given), portLines[dst]);
+		}
+
+		if (topo->numLinks == linkCapacity) {
+			linkCapacity = linkCapacity ? linkCapacity * 2 : 64;
+			topo->links = realloc(topo->links, linkCapacity * sizeof(struct link));
+			if (topo->links == NULL)
+				error("Error allocating topology");
+		}
+		// anything at or past INT_MAX marks a dead link
+		topo->links[topo->numLinks].src = src;
+		topo->links[topo->numLinks].dst = dst;
+		topo->links[topo->numLinks].cost = cost >= INT_MAX ? INT_MAX : (int) cost;
+		topo->numLinks++;
+	}
+	free(portLines);
+}
+
+struct routerAddress
+{
+	struct in6_addr host;
+	int port;
+	int id;
+};
+
+int compareAddresses(const void *a, const void *b)
+{
+	const struct routerAddress *x = a, *y = b;
+	int c = memcmp(&x->host, &y->host, sizeof(x->host));
+
+	if (c != 0)
+		return c;
+	return x->port < y->port ? -1 : x->port > y->port;
+}
+
+/* checkAddresses()
+ *
+ * Makes sure every router has an address of its own, and that no link joins
+ * an IPv4 router to an IPv6 one.
+ */
+void checkAddresses(const char *path, struct topology *topo)
+{
+	int n = topo->numRouters;
+	struct routerAddress *sorted = malloc(n * sizeof(struct routerAddress));
+	char a[ADDRESSSIZE], b[ADDRESSSIZE];
+	int i;
+
+	if (sorted == NULL)
+		error("Error allocating topology");
+	for (i=0; i<n; i++) {
+		if (topo->ports[i] < 0) {
+			fprintf(stderr, "%s: no port given for router %s\n", path, topo->names[i]);
+			exit(1);
+		}
+		sorted[i].host = topo->hosts[i];
+		sorted[i].port = topo->ports[i];
+		sorted[i].id = i;
+	}
+	qsort(sorted, n, sizeof(struct routerAddress), compareAddresses);
+	for (i=1; i<n; i++) {
+		if (compareAddresses(&sorted[i - 1], &sorted[i]) == 0) {
+			fprintf(stderr, "%s: routers %s and %s both use %s\n", path, topo->names[sorted[i - 1].id],
+				topo->names[sorted[i].id], formatAddress(topo, sorted[i].id, a));
+			exit(1);
+		}
+	}
+	free(sorted);
+
+	for (i=0; i<topo->numLinks; i++) {
+		const struct link *l = &topo->links[i];
+		if (isIPv6(topo, l->src) != isIPv6(topo, l->dst)) {
+			fprintf(stderr, "%s: router %s at %s cannot reach router %s at %s\n", path,
+				topo->names[l->src], formatAddress(topo, l->src, a), topo->names[l->dst], formatAddress(topo, l->dst, b));
+			exit(1);
+		}
+	}
+}
+
+/* readFile()
+ *
+ * Reads a whole file into one malloc'ed buffer and returns it.
+ */
+char *readFile(const char *path, size_t *size)
+{
+	struct stat st;
+	char *text;
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		error("Error opening sample file");
+
+	if (fstat(fileno(f), &st) < 0)
+		error("Error reading sample file");
+	text = malloc(st.st_size + 1);
+	if (text == NULL)
+		error("Error allocating topology");
+	*size = fread(text, 1, st.st_size, f);
+	if (ferror(f))
+		error("Error reading sample file");
+	fclose(f);
+	return text;
+}
+
+/* mapFile()
+ *
+ * Maps a whole file read-only and returns it, or NULL for an empty file.
+ */
+const char *mapFile(const char *path, size_t *size)
+{
+	struct stat st;
+	void *text;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		error("Error opening sample file");
+
+	if (fstat(fd, &st) < 0)
+		error("Error reading sample file");
+	*size = st.st_size;
+	if (*size == 0) {
+		close(fd);
+		return NULL;
+	}
+	text = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (text == MAP_FAILED)
+		error("Error mapping sample file");
+	madvise(text, *size, MADV_SEQUENTIAL);
+	close(fd);
+	return text;
+}
+
+/* isBinaryTopology()
+ *
+ * Returns true if the buffer starts with the binary topology magic.
+ */
+bool isBinaryTopology(const char *text, size_t size)
+{
+	return size >= sizeof(struct topologyHeader) && memcmp(text, TOPOMAGIC, 4) == 0;
+}
+
+/* loadBinaryTopology()
+ *
+ * Ingests a binary edge list straight out of the mapping. Names and links are
+ * used in place, links only on a little-endian host; a big-endian one swaps
+ * them into a copy. Only the array of name pointers is built. Routers must be
+ * stored in strictly increasing name order so that no renumbering is needed.
+ */
+void loadBinaryTopology(const char *path, const char *text, size_t size, struct topology *topo)
+{
+	const struct topologyHeader *h = (const struct topologyHeader *) text;
+	uint32_t version = le32toh(h->version);
+	uint64_t namesSize = le64toh(h->namesSize);
+	size_t n = le32toh(h->numRouters), m = le32toh(h->numLinks);
+	size_t portsAt = sizeof(*h), hostsAt = portsAt + 4 * n;
+	size_t offsetsAt = hostsAt + (version >= 2 ? 16 * n : 0), namesAt = offsetsAt + 4 * n;
+	size_t linksAt = namesAt + namesSize;
+	const uint32_t *ports, *offsets;
+	const struct link *links;
+	const char *names;
+	size_t i;
+
+	if (version < 1 || version > TOPOVERSION) {
+		fprintf(stderr, "%s: unsupported binary topology version %u\n", path, version);
+		exit(1);
+	}
+	if (n == 0 || n > INT_MAX || m > INT_MAX || namesSize % 4 != 0 || namesSize > size
+			|| linksAt > size || (size - linksAt) / sizeof(struct link) < m) {
+		fprintf(stderr, "%s: truncated or corrupt binary topology\n", path);
+		exit(1);
+	}
+	ports = (const uint32_t *) (text + portsAt);
+	offsets = (const uint32_t *) (text + offsetsAt);
+	names = text + namesAt;
+
+	topo->numRouters = (int) n;
+	topo->numLinks = (int) m;
+	topo->names = malloc(n * sizeof(char *));
+	topo->ports = malloc(n * sizeof(int));
+	topo->hosts = calloc(n, sizeof(struct in6_addr));
+	if (topo->names == NULL || topo->ports == NULL || topo->hosts == NULL)
+		error("Error allocating topology");
+	if (version >= 2)
+		memcpy(topo->hosts, text + hostsAt, n * sizeof(struct in6_addr));
+
+	for (i = 0; i < n; i++) {
+		uint32_t offset = le32toh(offsets[i]), port = le32toh(ports[i]);
+		if (offset >= namesSize || memchr(names + offset, '\0', namesSize - offset) == NULL
+				|| names[offset] == '\0') {
+			fprintf(stderr, "%s: router %zu has a bad name\n", path, i);
+			exit(1);
+		}
+		topo->names[i] = (char *) names + offset;
+		topo->ports[i] = port >= 1 && port <= 65535 ? (int) port : -1;
+		if (i > 0 && strcmp(topo->names[i - 1], topo->names[i]) >= 0) {
+			fprintf(stderr, "%s: routers %s and %s are out of name order\n", path, topo->names[i - 1], topo->names[i]);
+			exit(1);
+		}
+	}
+
+	links = (const struct link *) (text + linksAt);
+	if (le32toh(1) == 1) {
+		topo->links = (struct link *) links;
+	} else {
+		if ((topo->linkCopy = malloc(max(m, 1) * sizeof(struct link))) == NULL)
+			error("Error allocating topology");
+		for (i = 0; i < m; i++) {
+			topo->linkCopy[i].src = (int) le32toh((uint32_t) links[i].src);
+			topo->linkCopy[i].dst = (int) le32toh((uint32_t) links[i].dst);
+			topo->linkCopy[i].cost = (int) le32toh((uint32_t) links[i].cost);
+		}
+		topo->links = topo->linkCopy;
+	}
+	for (i = 0; i < m; i++) {
+		const struct link *l = &topo->links[i];
+		if (l->src < 0 || l->src >= (int) n || l->dst < 0 || l->dst >= (int) n || l->src == l->dst || l->cost < 0) {
+			fprintf(stderr, "%s: link %zu is invalid\n", path, i);
+			exit(1);
+		}
+	}
+	rehashRouters(topo, topo->numRouters);
+}
+
+/* loadTopology()
+ *
+ * Maps the topology file and loads it, either by tokenizing the text in place
+ * or by ingesting the binary edge list, and numbers its routers in name order.
+ */
+void loadTopology(const char *path, struct topology *topo)
+{
+	size_t size;
+	const char *text = mapFile(path, &size);
+
+	memset(topo, 0, sizeof(*topo));
+	if (isBinaryTopology(text, size)) {
+		loadBinaryTopology(path, text, size, topo);
+		// names and links point into the mapping, so it lives as long as the topology
+		topo->mapping = (void *) text;
+		topo->mappingSize = size;
+	} else {
+		parseTopology(path, text, size, topo);
+		if (text != NULL)
+			munmap((void *) text, size);
+	}
+
+	if (topo->numRouters == 0) {
+		fprintf(stderr, "%s: no routers in topology\n", path);
+		exit(1);
+	}
+	checkAddresses(path, topo);
+	if (topo->mapping == NULL)
+		sortRouters(topo);
+}
+
+/* freeTopology()
+ *
+ * Releases the names, ports and links of a topology.
+ */
+void freeTopology(struct topology *topo)
+{
+	int i;
+	if (topo->mapping != NULL) {
+		munmap(topo->mapping, topo->mappingSize);
+		free(topo->linkCopy);
+	} else {
+		for (i=0; i<topo->numRouters; i++)
+			free(topo->names[i]);
+		free(topo->links);
+	}
+	free(topo->names);
+	free(topo->ports);
+	free(topo->hosts);
+	free(topo->mapSlots);
+	memset(topo, 0, sizeof(*topo));
+}
+
+/* reinitializeBinaryTopologyFile()
+ *
+ * Marks every link touching the killed router dead in a binary topology that
+ * was already validated when it was loaded. Only the cost fields are written,
+ * so a live mapping of the file stays valid.
+ */
+void reinitializeBinaryTopologyFile(const char *path, const char *text, const char *killedRouter)
+{
+	const struct topologyHeader *h = (const struct topologyHeader *) text;
+	const uint32_t *offsets = (const uint32_t *) (text + sizeof(*h) + (h->version >= 2 ? 20 : 4) * (size_t) h->numRouters);
+	const char *names = (const char *) (offsets + h->numRouters);
+	const struct link *links = (const struct link *) (names + h->namesSize);
+	int dead = INT_MAX;
+	int killed = -1;
+	uint32_t i;
+
+	for (i = 0; i < h->numRouters; i++) {
+		if (strcmp(names + offsets[i], killedRouter) == 0)
+			killed = (int) i;
+	}
+
+	int fd = open(path, O_WRONLY);
+	if (fd < 0)
+		error("Error opening sample file");
+	for (i = 0; i < h->numLinks; i++) {
+		if (links[i].src != killed && links[i].dst != killed)
+			continue;
+		off_t at = (const char *) &links[i].cost - text;
+		if (pwrite(fd, &dead, sizeof(dead), at) != sizeof(dead))
+			error("Error writing sample file");
+	}
+	close(fd);
+}
+
+/* reinitalizeTopologyFile
+ *
+ * Rewrites the topology file so every link touching the killed router is dead.
+ */
+void reinitializeTopologyFile(const char *path, const char *killedRouter)
+{
+	// read lines from topology file
+	// if any line has the killed router in it, make the link cost INT_MAX
+
+	size_t size, killedLen = strlen(killedRouter);
+	char *text = readFile(path, &size);
+	const char *pos = text, *end = text + size;
+
+	if (isBinaryTopology(text, size)) {
+		reinitializeBinaryTopologyFile(path, text, killedRouter);
+		free(text);
+		return;
+	}
+
+	FILE *f = fopen(path, "w+");
+	if (f == NULL)
+		error("Error opening sample file");
+
+	// copy the file back line by line, replacing only the cost of dead links
+	while (pos < end) {
+		const char *eol = memchr(pos, '\n', end - pos);
+		const char *fields[4];
+		size_t lens[4];
+
+		if (eol == NULL)
+			eol = end;
+		if (splitFields(pos, eol, fields, lens, 4) == 4
+				&& ((lens[0] == killedLen && memcmp(fields[0], killedRouter, killedLen) == 0)
+				|| (lens[1] == killedLen && memcmp(fields[1], killedRouter, killedLen) == 0))) {
+			fwrite(pos, 1, fields[3] - pos, f);
+			fprintf(f, "%d", INT_MAX);
+			pos = fields[3] + lens[3];
+		}
+		fwrite(pos, 1, eol - pos, f);
+		if (eol < end)
+			fputc('\n', f);
+		pos = eol + 1;
+	}
+	fclose(f);
+	free(text);
+}
+
+/* allocateBatch()
+ *
+ * Carves a batch's slots out of arena a and points each message header at
+ * its own slot.
+ */
+void allocateBatch(struct arena *a, struct ioBatch *b)
+{
+	int k;
+
+	b->bufs = arenaAlloc(a, IOBATCH * DVMAXDATAGRAM);
+	b->msgs = arenaAlloc(a, IOBATCH * sizeof(struct mmsghdr));
+	b->iovs = arenaAlloc(a, IOBATCH * sizeof(struct iovec));
+	memset(b->msgs, 0, IOBATCH * sizeof(struct mmsghdr));
+	for (k = 0; k < IOBATCH; k++) {
+		b->iovs[k].iov_base = b->bufs + k * DVMAXDATAGRAM;
+		b->iovs[k].iov_len = DVMAXDATAGRAM;
+		b->msgs[k].msg_hdr.msg_iov = &b->iovs[k];
+		b->msgs[k].msg_hdr.msg_iovlen = 1;
+	}
+	b->count = 0;
+	b->sockfd = -1;
+}
+
+/* allocateNetwork()
+ *
+ * Sizes the arena from the topology and carves the tables of routers first
+ * .. last - 1, the ones this process runs, the adjacency index and the
+ * socket arrays out of it. The other routers' tables stay NULL.
+ */
+void allocateNetwork(struct network *net, int first, int last)
+{
+	int n = net->topo.numRouters;
+	int m = net->topo.numLinks;
+	size_t row = arenaBytes(n, sizeof(int));
+	size_t size = arenaBytes(n + 1, sizeof(struct router))
+		+ (size_t) (last - first) * (7 * row + arenaBytes((n + 63) / 64, sizeof(unsigned long long))
+			+ arenaBytes(n, sizeof(struct fibEntry)))	/* router tables, change versions, dirty bits and FIBs */
+		+ 3 * row			/* decoded DV and merge slots */
+		+ arenaBytes(n + 1, sizeof(int)) + 3 * arenaBytes(max(m, 1), sizeof(int))	/* adjacency */
+		+ 2 * arenaBytes(max(m, 1), sizeof(long long))	/* link pacing */
+		+ arenaBytes(n + m, sizeof(struct timer))
+		+ arenaBytes(n, sizeof(bool))
+		+ 2 * row
+		+ arenaBytes(n, sizeof(union socketAddress))
+		+ row
+		+ arenaBytes(DVMAXDATAGRAM, 1)
+		+ 2 * (arenaBytes(IOBATCH, DVMAXDATAGRAM) + arenaBytes(IOBATCH, sizeof(struct mmsghdr))
+			+ arenaBytes(IOBATCH, sizeof(struct iovec)));
+	int *matrices[7];
+	unsigned long long *dirty;
+	struct fibEntry *fib;
+	int i, k;
+
+	net->numRouters = n;
+	net->firstRouter = first;
+	net->lastRouter = last;
+	net->wakefd = -1;
+	net->killing = -1;
+	net->kicking = -1;
+	arenaInit(&net->arena, size);
+
+	net->routers = arenaAlloc(&net->arena, n * sizeof(struct router));
+	memset(net->routers, 0, n * sizeof(struct router));
+	for (i=0; i<n; i++)
+		net->routers[i].index = i;
+	/* each field of the tables is one matrix, a cache-aligned row per
+	 * router, so a pass over one field streams through memory */
+	for (k = 0; k < 7; k++)
+		matrices[k] = arenaAlloc(&net->arena, (last - first) * row);
+	dirty = arenaAlloc(&net->arena, (last - first) * arenaBytes((n + 63) / 64, sizeof(unsigned long long)));
+	fib = arenaAlloc(&net->arena, (last - first) * arenaBytes(n, sizeof(struct fibEntry)));
+	for (i=first; i<last; i++) {
+		struct router *r = &net->routers[i];
+		size_t at = (i - first) * (row / sizeof(int));
+		r->otherRouters = matrices[0] + at;
+		r->costs = matrices[1] + at;
+		r->outgoingPorts = matrices[2] + at;
+		r->destinationPorts = matrices[3] + at;
+		r->nextHop = matrices[4] + at;
+		r->feasibleCosts = matrices[5] + at;
+		r->changedAt = (unsigned int *) matrices[6] + at;
+		r->dirty = dirty + (i - first) * (arenaBytes((n + 63) / 64, sizeof(unsigned long long)) / sizeof(unsigned long long));
+		r->fib = fib + (i - first) * (arenaBytes(n, sizeof(struct fibEntry)) / sizeof(struct fibEntry));
+	}
+	net->rcvd.dests = arenaAlloc(&net->arena, n * sizeof(int));
+	net->rcvd.costs = arenaAlloc(&net->arena, n * sizeof(int));
+	net->drain.slot = arenaAlloc(&net->arena, n * sizeof(int));
+	memset(net->drain.slot, -1, n * sizeof(int));
+
+	net->adj.offsets = arenaAlloc(&net->arena, (n + 1) * sizeof(int));
+	net->adj.neighbors = arenaAlloc(&net->arena, max(m, 1) * sizeof(int));
+	net->adj.costs = arenaAlloc(&net->arena, max(m, 1) * sizeof(int));
+	net->adj.sentVersion = arenaAlloc(&net->arena, max(m, 1) * sizeof(unsigned int));
+	net->adj.sentAt = arenaAlloc(&net->arena, max(m, 1) * sizeof(long long));
+	net->adj.dueAt = arenaAlloc(&net->arena, max(m, 1) * sizeof(long long));
+	net->timers.heap = arenaAlloc(&net->arena, max(n + m, 1) * sizeof(struct timer));
+	net->killed = arenaAlloc(&net->arena, n * sizeof(bool));
+	memset(net->killed, 0, n * sizeof(bool));
+	net->sockfd = arenaAlloc(&net->arena, n * sizeof(int));
+	net->backlog = arenaAlloc(&net->arena, n * sizeof(int));
+	net->numBacklogged = 0;
+	net->serveraddr = arenaAlloc(&net->arena, n * sizeof(union socketAddress));
+	net->seq = arenaAlloc(&net->arena, n * sizeof(unsigned int));
+	memset(net->seq, 0, n * sizeof(unsigned int));
+	net->buf = arenaAlloc(&net->arena, DVMAXDATAGRAM);
+	allocateBatch(&net->arena, &net->in);
+	allocateBatch(&net->arena, &net->out);
+}
+
+/* resetTable()
+ *
+ * Resets router a's table to know only a zero-cost route to itself.
+ */
+void resetTable(struct network *net, int a) {
+	struct router *rp = &net->routers[a];
+	int n = net->numRouters;
+	int d;
+
+	for (d = 0; d < n; d++) {
+		rp->otherRouters[d] = -1;
+		rp->costs[d] = INT_MAX;
+		rp->outgoingPorts[d] = 0;
+		rp->destinationPorts[d] = 0;
+		rp->nextHop[d] = -1;
+		rp->fib[d].nextHop = -1;
+		rp->fib[d].port = 0;
+		rp->feasibleCosts[d] = INT_MAX;
+		rp->changedAt[d] = 0;
+	}
+	memset(rp->dirty, 0, (n + 63) / 64 * sizeof(unsigned long long));
+	rp->dirtySince = 0;
+	rp->backlogged = false;
+	// version 1 holds the initial routes, which no neighbor has seen yet
+	rp->index = a;
+	rp->version = 1;
+	rp->changedAt[a] = 1;
+	rp->dirty[a / 64] |= 1ULL << (a % 64);
+	rp->otherRouters[a] = a;
+	rp->costs[a] = 0;
+	rp->destinationPorts[a] = routerToPort(net, a);
+	rp->outgoingPorts[a] = routerToPort(net, a);
+	rp->nextHop[a] = a;
+	rp->fib[a].nextHop = a;
+	rp->fib[a].port = rp->outgoingPorts[a];
+	rp->feasibleCosts[a] = 0;
+}
+
+/* reinitializeTables()
+ *
+ * Resets every table this process runs to know only a zero-cost route to
+ * itself.
+ */
+void reinitializeTables(struct network *net) {
+	int a;
+	for (a = net->firstRouter; a < net->lastRouter; a++)
+		resetTable(net, a);
+}
+
+/* initializeFromFile()
+ *
+ * Builds the adjacency index from the topology and initializes every routing
+ * table this process runs with its direct links.
+ */
+void initializeFromFile(struct network *net) {
+	int i, e;
+
+	buildAdjacency(net);
+
+	for (i=net->firstRouter; i<net->lastRouter; i++) {
+		struct router *table = &net->routers[i];
+		for (e = net->adj.offsets[i]; e < net->adj.offsets[i + 1]; e++) {
+			int dst = net->adj.neighbors[e];
+			table->otherRouters[dst] = dst;
+			table->costs[dst] = net->adj.costs[e];
+			table->outgoingPorts[dst] = routerToPort(net, i);
+			table->destinationPorts[dst] = routerToPort(net, dst);
+			table->nextHop[dst] = dst;
+			table->fib[dst].nextHop = dst;
+			table->fib[dst].port = table->outgoingPorts[dst];
+			table->feasibleCosts[dst] = net->adj.costs[e];
+			table->changedAt[dst] = 1;
+			table->dirty[dst / 64] |= 1ULL << (dst % 64);
+		}
+	}
+}
+
+/* dijkstra()
+ *
+ * Shortest paths from router s over the live links into dist and hops,
+ * hops holding the first router along each path. heap has room for a
+ * pushed entry per link and one more.
+ */
+void dijkstra(struct network *net, int s, int *dist, int *hops, struct pathEntry *heap)
+{
+	int n = net->numRouters, count = 0;
+	int d, e, k, child;
+
+	for (d = 0; d < n; d++) {
+		dist[d] = INT_MAX;
+		hops[d] = -1;
+	}
+	dist[s] = 0;
+	hops[s] = s;
+	heap[count++] = (struct pathEntry) { 0, s };
+	while (count > 0) {
+		struct pathEntry top = heap[0], last = heap[--count];
+		for (k = 0; (child = 2 * k + 1) < count; k = child) {
+			if (child + 1 < count && heap[child + 1].cost < heap[child].cost)
+				child++;
+			if (last.cost <= heap[child].cost)
+				break;
+			heap[k] = heap[child];
+		}
+		heap[k] = last;
+
+		// already settled at a lower cost
+		if (top.cost > dist[top.router])
+			continue;
+		for (e = net->adj.offsets[top.router]; e < net->adj.offsets[top.router + 1]; e++) {
+			int v = net->adj.neighbors[e], cost = addCost(top.cost, net->adj.costs[e]);
+			if (cost >= dist[v])
+				continue;
+			dist[v] = cost;
+			hops[v] = top.router == s ? v : hops[top.router];
+			for (k = count++; k > 0 && heap[(k - 1) / 2].cost > cost; k = (k - 1) / 2)
+				heap[k] = heap[(k - 1) / 2];
+			heap[k] = (struct pathEntry) { cost, v };
+		}
+	}
+}
+
+/* solveSources()
+ *
+ * A solver thread: runs Dijkstra from each source it takes.
+ */
+void *solveSources(void *arg)
+{
+	struct allPairs *ap = arg;
+	struct network *net = ap->net;
+	struct pathEntry *heap;
+	int s;
+
+	if ((heap = malloc((net->adj.offsets[net->numRouters] + 1) * sizeof(struct pathEntry))) == NULL)
+		error("Error allocating the solver");
+	while ((s = __atomic_fetch_add(&ap->nextSource, 1, __ATOMIC_RELAXED)) < ap->last)
+		dijkstra(net, s, ap->tables[s].costs, ap->tables[s].nextHop, heap);
+	free(heap);
+	return NULL;
+}
+
+/* relaxBlock()
+ *
+ * The Floyd-Warshall step for pivots in block kb over the pairs of rows in
+ * block ib and columns in block jb.
+ */
+void relaxBlock(struct router *tables, int n, int ib, int jb, int kb)
+{
+	int k, i, j;
+
+	for (k = kb; k < min(kb + FWBLOCK, n); k++) {
+		const int *through = tables[k].costs;
+		for (i = ib; i < min(ib + FWBLOCK, n); i++) {
+			int *dist = tables[i].costs, *hops = tables[i].nextHop;
+			int toPivot = dist[k];
+			if (toPivot == INT_MAX)
+				continue;
+			for (j = jb; j < min(jb + FWBLOCK, n); j++) {
+				int cost = addCost(toPivot, through[j]);
+				if (cost < dist[j]) {
+					dist[j] = cost;
+					hops[j] = hops[k];
+				}
+			}
+		}
+	}
+}
+
+/* floydWarshall()
+ *
+ * Shortest paths between every pair of routers, FWBLOCK x FWBLOCK blocks at
+ * a time: for each block of pivots, the block on the diagonal first, then
+ * the rest of its block row and column, then everything else, so each
+ * block only reads blocks already final for those pivots.
+ */
+void floydWarshall(struct network *net, struct router *tables)
+{
+	int n = net->numRouters;
+	int i, e, ib, jb, kb;
+
+	for (i = 0; i < n; i++) {
+		int *dist = tables[i].costs, *hops = tables[i].nextHop;
+		for (e = 0; e < n; e++) {
+			dist[e] = INT_MAX;
+			hops[e] = -1;
+		}
+		dist[i] = 0;
+		hops[i] = i;
+		for (e = net->adj.offsets[i]; e < net->adj.offsets[i + 1]; e++) {
+			if (net->adj.costs[e] < dist[net->adj.neighbors[e]]) {
+				dist[net->adj.neighbors[e]] = net->adj.costs[e];
+				hops[net->adj.neighbors[e]] = net->adj.neighbors[e];
+			}
+		}
+	}
+	for (kb = 0; kb < n; kb += FWBLOCK) {
+		relaxBlock(tables, n, kb, kb, kb);
+		for (jb = 0; jb < n; jb += FWBLOCK) {
+			if (jb != kb) {
+				relaxBlock(tables, n, kb, jb, kb);
+				relaxBlock(tables, n, jb, kb, kb);
+			}
+		}
+		for (ib = 0; ib < n; ib += FWBLOCK) {
+			for (jb = 0; jb < n; jb += FWBLOCK) {
+				if (ib != kb && jb != kb)
+					relaxBlock(tables, n, ib, jb, kb);
+			}
+		}
+	}
+}
+
+/* solveAllPairs()
+ *
+ * Fills the costs and nextHop of tables with the shortest paths over the
+ * live links from every router this process runs, unreachable at or above
+ * the infinity metric. A dense network run whole goes through blocked
+ * Floyd-Warshall, anything else through Dijkstra from each source on the
+ * given number of threads. Returns the method's name.
+ */
+const char *solveAllPairs(struct network *net, struct router *tables, int threads)
+{
+	int n = net->numRouters, m = net->adj.offsets[n];
+	struct allPairs ap = { net, tables, net->firstRouter, net->lastRouter };
+	const char *method = "Dijkstra";
+	pthread_t *workers;
+	int i, d, k;
+
+	if (net->lastRouter - net->firstRouter == n && (long long) m * DENSEGRAPH >= (long long) n * n) {
+		floydWarshall(net, tables);
+		method = "Floyd-Warshall";
+	} else {
+		threads = max(min(threads, net->lastRouter - net->firstRouter), 1);
+		if ((workers = malloc(threads * sizeof(pthread_t))) == NULL)
+			error("Error allocating the solver");
+		for (k = 1; k < threads; k++) {
+			if ((errno = pthread_create(&workers[k], NULL, solveSources, &ap)) != 0)
+				error("Error starting solver");
+		}
+		solveSources(&ap);
+		for (k = 1; k < threads; k++)
+			pthread_join(workers[k], NULL);
+		free(workers);
+	}
+	for (i = net->firstRouter; i < net->lastRouter; i++) {
+		for (d = 0; d < n; d++) {
+			if (tables[i].costs[d] >= net->infinity) {
+				tables[i].costs[d] = INT_MAX;
+				tables[i].nextHop[d] = -1;
+			}
+		}
+	}
+	return method;
+}
+
+/* allocateSolution()
+ *
+ * Returns tables with costs and nextHop rows for the routers this process
+ * runs, to solve into.
+ */
+struct router *allocateSolution(struct network *net)
+{
+	int n = net->numRouters, rows = net->lastRouter - net->firstRouter;
+	struct router *tables;
+	int *cells;
+	int i;
+
+	if ((tables = calloc(n, sizeof(struct router))) == NULL
+			|| (cells = aligned_alloc(ARENAALIGN, arenaBytes((size_t) 2 * rows * n, sizeof(int)))) == NULL)
+		error("Error allocating the solver");
+	for (i = net->firstRouter; i < net->lastRouter; i++) {
+		tables[i].index = i;
+		tables[i].costs = cells + (size_t) 2 * (i - net->firstRouter) * n;
+		tables[i].nextHop = tables[i].costs + n;
+	}
+	return tables;
+}
+
+/* freeSolution()
+ *
+ * Releases what allocateSolution() returned.
+ */
+void freeSolution(struct network *net, struct router *tables)
+{
+	free(tables[net->firstRouter].costs);
+	free(tables);
+}
+
+/* installSolution()
+ *
+ * Starts every router this process runs off with its shortest paths
+ * already in its table, as part of its initial routes.
+ */
+void installSolution(struct network *net, int threads)
+{
+	struct router *tables = allocateSolution(net);
+	int i, d;
+
+	solveAllPairs(net, tables, threads);
+	for (i = net->firstRouter; i < net->lastRouter; i++) {
+		struct router *table = &net->routers[i];
+		for (d = 0; d < net->numRouters; d++) {
+			if (d != i && (tables[i].costs[d] != table->costs[d] || tables[i].nextHop[d] != table->nextHop[d]))
+				setRoute(net, table, d, tables[i].costs[d], tables[i].nextHop[d]);
+		}
+	}
+	freeSolution(net, tables);
+}
+
+/* checkSolution()
+ *
+ * Checks the cost of every route of every live router against the
+ * shortest path and prints how many differ. Routes of equal cost through
+ * different neighbors are both right.
+ */
+void checkSolution(struct network *net, int threads)
+{
+	struct router *tables = allocateSolution(net);
+	long long checked = 0, wrong = 0;
+	long long started = nowUsec();
+	const char *method = solveAllPairs(net, tables, threads);
+	int i, d;
+
+	for (i = net->firstRouter; i < net->lastRouter; i++) {
+		if (net->killed[i])
+			continue;
+		for (d = 0; d < net->numRouters; d++, checked++) {
+			if (tables[i].costs[d] == net->routers[i].costs[d])
+				continue;
+			if (wrong++ < 5)
+				printf("Router %s reaches %s at cost %d, shortest path %d\n", routerName(net, i),
+					routerName(net, d), net->routers[i].costs[d], tables[i].costs[d]);
+		}
+	}
+	printf("%lld of %lld routes differ from %s, solved in %.3f s\n", wrong, checked, method,
+		(nowUsec() - started) / 1e6);
+	freeSolution(net, tables);
+}
+
+/* reserveDescriptors()
+ *
+ * Raises the open file limit to fit count descriptors, plus stdio and output
+ * files.
+ */
+void reserveDescriptors(int count)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t) count + 64) {
+		rl.rlim_cur = rl.rlim_max == RLIM_INFINITY ? (rlim_t) count + 64
+			: (rlim_t) max(rl.rlim_max, (rlim_t) count + 64);
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+}
+
+/* routerAddress()
+ *
+ * Fills in the socket address router i listens on, to bind or to send to. A
+ * router given only a port binds every IPv4 address and is reached over
+ * loopback.
+ */
+void routerAddress(struct network *net, int i, union socketAddress *a, bool binding)
+{
+	const struct in6_addr *host = &net->topo.hosts[i];
+
+	memset(a, 0, sizeof(*a));
+	if (isIPv6(&net->topo, i)) {
+		a->in6.sin6_family = AF_INET6;
+		a->in6.sin6_addr = *host;
+		a->in6.sin6_port = htons(routerToPort(net, i));
+		return;
+	}
+	a->in.sin_family = AF_INET;
+	if (IN6_IS_ADDR_V4MAPPED(host))
+		memcpy(&a->in.sin_addr, host->s6_addr + 12, sizeof(a->in.sin_addr));
+	else
+		a->in.sin_addr.s_addr = htonl(binding ? INADDR_ANY : INADDR_LOOPBACK);
+	a->in.sin_port = htons(routerToPort(net, i));
+}
+
+/* addressLength()
+ *
+ * Returns the length of a socket address of a's family.
+ */
+socklen_t addressLength(const union socketAddress *a)
+{
+	return a->sa.sa_family == AF_INET6 ? sizeof(a->in6) : sizeof(a->in);
+}
+
+/* openSockets()
+ *
+ * Creates and binds one UDP socket per router this process runs, on the
+ * router's address, and registers each with the epoll instance, the router
+ * itself as the event data. Every router's address is filled in, for
+ * sending.
+ */
+void openSockets(struct network *net)
+{
+	union socketAddress local;
+	struct epoll_event ev;
+	char given[ADDRESSSIZE];
+	int optval; /* flag value for setsockopt */
+	int i;
+
+	reserveDescriptors(net->lastRouter - net->firstRouter);
+	if ((net->epollfd = epoll_create1(0)) < 0)
+		error("Error creating epoll instance");
+
+	for (i=0; i<net->numRouters; i++) {
+		routerAddress(net, i, &net->serveraddr[i], false);
+		net->sockfd[i] = -1;
+		if (i < net->firstRouter || i >= net->lastRouter)
+			continue;
+
+		/* create parent socket */
+		routerAddress(net, i, &local, true);
+		if ( (net->sockfd[i] = socket(local.sa.sa_family, SOCK_DGRAM, 0)) < 0 )
+			error("Error opening socket");
+
+		/* server can be rerun immediately after killed */
+		optval = 1;
+		setsockopt(net->sockfd[i], SOL_SOCKET, SO_REUSEADDR, (const void *)&optval, sizeof(int));
+		/* updates are sent once, so give bursts room instead of dropping them */
+		optval = RCVBUFSIZE;
+		setsockopt(net->sockfd[i], SOL_SOCKET, SO_RCVBUF, (const void *)&optval, sizeof(int));
+
+		/* bind: associate parent socket with the router's address */
+		if (bind(net->sockfd[i], &local.sa, addressLength(&local)) < 0) {
+			fprintf(stderr, "Router %s at %s: ", routerName(net, i), formatAddress(&net->topo, i, given));
+			error("Error on binding");
+		}
+
+		/* reads never block, so readiness only needs reporting on arrival */
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.ptr = &net->routers[i];
+		if (epoll_ctl(net->epollfd, EPOLL_CTL_ADD, net->sockfd[i], &ev) < 0)
+			error("Error registering socket");
+	}
+}
+
+/* uringEnter()
+ *
+ * Submits every SQE written so far and, if minComplete is positive, waits
+ * for that many completions or timeout usecs, forever if timeout is negative.
+ */
+void uringEnter(struct network *net, unsigned int minComplete, long long timeout)
+{
+	struct uring *u = &net->uring;
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned int flags = 0;
+	void *argp = NULL;
+	size_t argsz = 0;
+	int ret;
+
+	if (minComplete > 0)
+		flags |= IORING_ENTER_GETEVENTS;
+	if (minComplete > 0 && timeout >= 0) {
+		ts.tv_sec = timeout / 1000000;
+		ts.tv_nsec = (timeout % 1000000) * 1000;
+		memset(&arg, 0, sizeof(arg));
+		arg.sigmask_sz = _NSIG / 8;
+		arg.ts = (uint64_t) (uintptr_t) &ts;
+		flags |= IORING_ENTER_EXT_ARG;
+		argp = &arg;
+		argsz = sizeof(arg);
+	}
+	if ((ret = syscall(__NR_io_uring_enter, u->fd, u->toSubmit, minComplete, flags, argp, argsz)) < 0) {
+		if (errno != ETIME && errno != EINTR)
+			error("Error entering io_uring");
+		return;
+	}
+	u->toSubmit -= ret;
+}
+
+/* uringSqe()
+ *
+ * Returns a zeroed SQE to fill in, submitting first if the queue is full.
+ * The kernel only reads SQEs in io_uring_enter, so it is queued right away.
+ */
+struct io_uring_sqe *uringSqe(struct network *net)
+{
+	struct uring *u = &net->uring;
+	unsigned int tail = *u->sqTail, index;
+	struct io_uring_sqe *sqe;
+
+	if (tail - __atomic_load_n(u->sqHead, __ATOMIC_ACQUIRE) == u->sqEntries)
+		uringEnter(net, 0, -1);
+	index = tail & u->sqMask;
+	sqe = &u->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	u->sqArray[index] = index;
+	__atomic_store_n(u->sqTail, tail + 1, __ATOMIC_RELEASE);
+	u->toSubmit++;
+	return sqe;
+}
+
+/* uringArm()
+ *
+ * Posts a multishot receive on router i's socket that takes its buffers from
+ * the provided buffer ring.
+ */
+void uringArm(struct network *net, int i)
+{
+	struct io_uring_sqe *sqe = uringSqe(net);
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = net->sockfd[i];
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URINGGROUP;
+	sqe->user_data = URINGRECV << 32 | (unsigned int) i;
+	net->uring.armed[i] = true;
+}
+
+/* uringRecycle()
+ *
+ * Hands receive buffer bid back to the kernel.
+ */
+void uringRecycle(struct network *net, int bid)
+{
+	struct uring *u = &net->uring;
+	struct io_uring_buf *b = &u->bufRing->bufs[u->bufTail & (URINGBUFFERS - 1)];
+
+	// the ring tail shares bufs[0].resv, so leave resv alone
+	b->addr = (uint64_t) (uintptr_t) (u->bufs + (size_t) bid * DVMAXDATAGRAM);
+	b->len = DVMAXDATAGRAM;
+	b->bid = (unsigned short) bid;
+	u->bufTail++;
+	__atomic_store_n(&u->bufRing->tail, u->bufTail, __ATOMIC_RELEASE);
+}
+
+/* uringReap()
+ *
+ * Consumes every completion in the ring. Received datagrams are queued on
+ * ready, finished sends are counted off their chain, and receives that ended
+ * are queued to be posted again.
+ */
+void uringReap(struct network *net)
+{
+	struct uring *u = &net->uring;
+	unsigned int head = *u->cqHead, tail = __atomic_load_n(u->cqTail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail; head++) {
+		struct io_uring_cqe *cqe = &u->cqes[head & u->cqMask];
+		unsigned long long kind = cqe->user_data >> 32;
+		int id = (int) (cqe->user_data & 0xffffffff);
+
+		if (kind == URINGSEND) {
+			struct ioBatch *b = &u->chains[id / IOBATCH];
+			u->inFlight[id / IOBATCH]--;
+			u->sendsInFlight--;
+			if (cqe->res == -ECANCELED) {
+				// an earlier send in the chain failed and took this one with it
+				struct msghdr *h = &b->msgs[id % IOBATCH].msg_hdr;
+				if (sendto(b->sockfd, h->msg_iov->iov_base, h->msg_iov->iov_len, 0, h->msg_name, h->msg_namelen) < 0)
+					error("Error sending to client");
+			} else if (cqe->res < 0) {
+				errno = -cqe->res;
+				error("Error sending to client");
+			}
+			continue;
+		}
+
+		if (!(cqe->flags & IORING_CQE_F_MORE)) {
+			u->armed[id] = false;
+			u->rearm[u->numRearm++] = id;
+		}
+		if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP) {
+			u->unsupported = true;
+		} else if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+			errno = -cqe->res;
+			error("Error receiving datagram from client");
+		} else if (cqe->flags & IORING_CQE_F_BUFFER) {
+			struct completion *c = &u->ready[u->numReady++];
+			c->router = id;
+			c->bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+			c->len = max(cqe->res, 0);
+		}
+	}
+	__atomic_store_n(u->cqHead, head, __ATOMIC_RELEASE);
+}
+
+/* uringRearm()
+ *
+ * Posts a new multishot receive for every router whose last one ended,
+ * typically because the buffer ring ran dry.
+ */
+void uringRearm(struct network *net)
+{
+	struct uring *u = &net->uring;
+	int k;
+
+	for (k = 0; k < u->numRearm; k++) {
+		if (!u->armed[u->rearm[k]])
+			uringArm(net, u->rearm[k]);
+	}
+	u->numRearm = 0;
+}
+
+/* uringTeardown()
+ *
+ * Closes the ring, which cancels every posted receive, and releases it,
+ * handing net->out its own batch back.
+ */
+void uringTeardown(struct network *net)
+{
+	struct uring *u = &net->uring;
+
+	if (u->fd >= 0)
+		close(u->fd);
+	if (u->chains[0].bufs != NULL)
+		net->out = u->chains[0];
+	if (u->sqRing != NULL && u->sqRing != MAP_FAILED)
+		munmap(u->sqRing, max(u->sqRingSize, u->cqRingSize));
+	if (u->sqes != NULL && u->sqes != MAP_FAILED)
+		munmap(u->sqes, u->sqesSize);
+	if (u->bufRing != NULL && u->bufRing != MAP_FAILED)
+		munmap(u->bufRing, u->bufRingSize);
+	free(u->bufs);
+	free(u->ready);
+	free(u->handling);
+	free(u->armed);
+	free(u->rearm);
+	arenaFree(&u->chainArena);
+	memset(u, 0, sizeof(*u));
+	u->fd = -1;
+}
+
+/* uringSetup()
+ *
+ * Sets up the io_uring backend: maps the rings, registers the provided buffer
+ * ring and posts a multishot receive on every router socket. Returns false,
+ * with nothing left behind, if the kernel lacks any of it.
+ */
+bool uringSetup(struct network *net)
+{
+	struct uring *u = &net->uring;
+	struct io_uring_params p;
+	struct io_uring_buf_reg reg;
+	int n = net->numRouters, k;
+
+	memset(u, 0, sizeof(*u));
+	memset(&p, 0, sizeof(p));
+	// room for a completion per receive buffer, per router and per send
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = URINGBUFFERS + n + URINGENTRIES;
+	if ((u->fd = syscall(__NR_io_uring_setup, URINGENTRIES, &p)) < 0) {
+		u->fd = -1;
+		return false;
+	}
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)) {
+		uringTeardown(net);
+		return false;
+	}
+
+	u->sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	u->cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	u->sqRing = mmap(NULL, max(u->sqRingSize, u->cqRingSize), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	u->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	u->bufRingSize = URINGBUFFERS * sizeof(struct io_uring_buf);
+	u->bufRing = mmap(NULL, u->bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (u->sqRing == MAP_FAILED || u->sqes == MAP_FAILED || u->bufRing == MAP_FAILED) {
+		uringTeardown(net);
+		return false;
+	}
+	u->cqRing = u->sqRing;
+	u->sqHead = (unsigned int *) ((char *) u->sqRing + p.sq_off.head);
+	u->sqTail = (unsigned int *) ((char *) u->sqRing + p.sq_off.tail);
+	u->sqArray = (unsigned int *) ((char *) u->sqRing + p.sq_off.array);
+	u->sqMask = *(unsigned int *) ((char *) u->sqRing + p.sq_off.ring_mask);
+	u->sqEntries = p.sq_entries;
+	u->cqHead = (unsigned int *) ((char *) u->cqRing + p.cq_off.head);
+	u->cqTail = (unsigned int *) ((char *) u->cqRing + p.cq_off.tail);
+	u->cqMask = *(unsigned int *) ((char *) u->cqRing + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *) ((char *) u->cqRing + p.cq_off.cqes);
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t) (uintptr_t) u->bufRing;
+	reg.ring_entries = URINGBUFFERS;
+	reg.bgid = URINGGROUP;
+	if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		uringTeardown(net);
+		return false;
+	}
+
+	u->bufs = malloc((size_t) URINGBUFFERS * DVMAXDATAGRAM);
+	u->ready = malloc(URINGBUFFERS * sizeof(struct completion));
+	u->handling = malloc(URINGBUFFERS * sizeof(struct completion));
+	u->armed = calloc(n, sizeof(bool));
+	u->rearm = malloc(n * sizeof(int));
+	if (u->bufs == NULL || u->ready == NULL || u->handling == NULL || u->armed == NULL || u->rearm == NULL)
+		error("Error allocating io_uring buffers");
+	for (k = 0; k < URINGBUFFERS; k++)
+		uringRecycle(net, k);
+	for (k = 0; k < n; k++)
+		uringArm(net, k);
+
+	// a kernel without multishot receives fails them straight away
+	uringEnter(net, 0, -1);
+	uringReap(net);
+	if (u->unsupported) {
+		uringTeardown(net);
+		return false;
+	}
+
+	// net->out's own batch is the first chain
+	arenaInit(&u->chainArena, (URINGCHAINS - 1) * (arenaBytes(IOBATCH, DVMAXDATAGRAM)
+		+ arenaBytes(IOBATCH, sizeof(struct mmsghdr)) + arenaBytes(IOBATCH, sizeof(struct iovec))));
+	u->chains[0] = net->out;
+	for (k = 1; k < URINGCHAINS; k++)
+		allocateBatch(&u->chainArena, &u->chains[k]);
+	return true;
+}
+
+/* uringFlushSends()
+ *
+ * Sends the queued fan-out as one chain of linked SENDMSG SQEs, so it goes
+ * out in order with a single io_uring_enter, and moves net->out on to the
+ * next chain's slots. Its completions are reaped along with the receives;
+ * only if the next chain is somehow still in flight does this wait for it.
+ */
+void uringFlushSends(struct network *net)
+{
+	struct uring *u = &net->uring;
+	struct ioBatch *b = &net->out;
+	int c = u->chain, k;
+
+	// keep the chain in one submission
+	if (u->sqEntries - (*u->sqTail - __atomic_load_n(u->sqHead, __ATOMIC_ACQUIRE)) < (unsigned int) b->count)
+		uringEnter(net, 0, -1);
+	for (k = 0; k < b->count; k++) {
+		struct io_uring_sqe *sqe = uringSqe(net);
+		sqe->opcode = IORING_OP_SENDMSG;
+		sqe->fd = b->sockfd;
+		sqe->addr = (uint64_t) (uintptr_t) &b->msgs[k].msg_hdr;
+		sqe->len = 1;
+		if (k < b->count - 1)
+			sqe->flags = IOSQE_IO_LINK;
+		sqe->user_data = URINGSEND << 32 | (unsigned int) (c * IOBATCH + k);
+	}
+	uringEnter(net, 0, -1);
+	net->stats.sendCalls++;
+	u->chains[c].sockfd = b->sockfd;
+	u->inFlight[c] = b->count;
+	u->sendsInFlight += b->count;
+
+	c = (c + 1) % URINGCHAINS;
+	while (u->inFlight[c] > 0) {
+		uringEnter(net, 1, -1);
+		uringReap(net);
+	}
+	u->chain = c;
+	*b = u->chains[c];
+	b->count = 0;
+}
+
+/* udpFlush()
+ *
+ * Sends every queued datagram, as few sendmmsg calls as it takes.
+ */
+void udpFlush(struct network *net)
+{
+	struct ioBatch *b = &net->out;
+	int sent = 0, n;
+
+	if (net->ringed && b->count > 0) {
+		uringFlushSends(net);
+		return;
+	}
+	while (sent < b->count) {
+		if ((n = sendmmsg(b->sockfd, b->msgs + sent, b->count - sent, 0)) < 0) {
+			if (errno != ENOSYS)
+				error("Error sending to client");
+			// no sendmmsg in this kernel: send one at a time from now on
+			net->batched = false;
+			for (; sent < b->count; sent++) {
+				struct msghdr *h = &b->msgs[sent].msg_hdr;
+				if (sendto(b->sockfd, h->msg_iov->iov_base, h->msg_iov->iov_len, 0, h->msg_name, h->msg_namelen) < 0)
+					error("Error sending to client");
+				net->stats.sendCalls++;
+			}
+			break;
+		}
+		net->stats.sendCalls++;
+		sent += n;
+	}
+	b->count = 0;
+}
+
+/* udpBuffer()
+ *
+ * Returns where router i's next datagram should be written: the next free
+ * batch slot, or the single datagram buffer without batching.
+ */
+unsigned char *udpBuffer(struct network *net, int i, int e)
+{
+	struct ioBatch *b = &net->out;
+
+	(void) e;
+	if (!net->batched && !net->ringed)
+		return net->buf;
+	if (b->count == IOBATCH || (b->count > 0 && b->sockfd != net->sockfd[i]))
+		udpFlush(net);
+	b->sockfd = net->sockfd[i];
+	return b->bufs + b->count * DVMAXDATAGRAM;
+}
+
+/* udpSend()
+ *
+ * Sends the len bytes router i just wrote to udpBuffer() to the neighbor on
+ * link e, or queues them for the next udpFlush().
+ */
+void udpSend(struct network *net, int i, int e, size_t len)
+{
+	struct ioBatch *b = &net->out;
+	union socketAddress *to = &net->serveraddr[net->adj.neighbors[e]];
+
+	net->stats.datagramsSent++;
+	net->stats.bytesSent += len;
+	if (!net->batched && !net->ringed) {
+		if (sendto(net->sockfd[i], net->buf, len, 0, &to->sa, addressLength(to)) < 0)
+			error("Error sending to client");
+		net->stats.sendCalls++;
+		return;
+	}
+	b->iovs[b->count].iov_len = len;
+	b->msgs[b->count].msg_hdr.msg_name = to;
+	b->msgs[b->count].msg_hdr.msg_namelen = addressLength(to);
+	b->count++;
+}
+
+/* udpKick()
+ *
+ * Has router i send a DV to itself, which it relaxes against and advertises
+ * its table after.
+ */
+void udpKick(struct network *net, int i)
+{
+	struct dvWriter w;
+
+	beginVector(&w, net->buf, i, net->seq[i]++, 0);
+	addEntry(&w, i, 0);
+	if (sendto(net->sockfd[i], net->buf, endVector(&w), 0, &net->serveraddr[i].sa, addressLength(&net->serveraddr[i])) < 0)
+		error("Error sending to client");
+}
+
+/* settleDirty()
+ *
+ * Once every live neighbor of router i has been sent its whole table, its
+ * dirty destinations are clean again.
+ */
+void settleDirty(struct network *net, int i)
+{
+	struct router *table = &net->routers[i];
+	int e;
+
+	for (e = net->adj.offsets[i]; e < net->adj.offsets[i + 1]; e++) {
+		if (net->adj.costs[e] != INT_MAX && net->adj.sentVersion[e] != table->version)
+			return;
+	}
+	memset(table->dirty, 0, (net->numRouters + 63) / 64 * sizeof(unsigned long long));
+	table->dirtySince = table->version;
+}
+
+/* sendChanges()
+ *
+ * Sends router i's neighbor over link e every route that changed after the
+ * table version last advertised over that link, one datagram per
+ * DVMAXDATAGRAM worth of entries. Routes through that neighbor are left out
+ * or advertised unreachable, as net->advertise says. Returns false if the
+ * link could not take all of it.
+ */
+bool sendChanges(struct network *net, int i, int e, unsigned int flags)
+{
+	struct router *table = &net->routers[i];
+	int neighbor = net->adj.neighbors[e], n = net->numRouters;
+	unsigned int since = net->adj.sentVersion[e];
+	// a neighbor short of a full update only needs what is dirty
+	bool sparse = since >= table->dirtySince;
+	unsigned char *buf;
+	struct dvWriter w;
+	int dest = sparse ? nextDirty(table, 0, n) : 0;
+
+	do {
+		if ((buf = net->transport->buffer(net, i, e)) == NULL)
+			return false;
+		beginVector(&w, buf, i, net->seq[i], flags);
+		for (; dest < n; dest = sparse ? nextDirty(table, dest + 1, n) : dest + 1) {
+			int cost = table->costs[dest];
+			if (table->changedAt[dest] <= since)
+				continue;
+			if (table->nextHop[dest] == neighbor) {
+				if (net->advertise == SPLIT_HORIZON)
+					continue;
+				if (net->advertise == POISON_REVERSE)
+					cost = INT_MAX;
+			}
+			if (!addEntry(&w, dest, cost))
+				break;
+		}
+		if (w.count == 0)
+			break;
+
+		net->seq[i]++;
+		net->transport->send(net, i, e, endVector(&w));
+	} while (dest < n);
+	return true;
+}
+
+/* sendUpdate()
+ *
+ * Sends router i's changes over link e right away. If the link is full, the
+ * changes stay unsent and go out with whatever else changed once the link
+ * has had a moment to drain.
+ */
+void sendUpdate(struct network *net, int i, int e, unsigned int flags, long long now)
+{
+	struct timerQueue *q = &net->timers;
+
+	if (!sendChanges(net, i, e, flags)) {
+		if (net->adj.dueAt[e] == 0) {
+			net->adj.dueAt[e] = now + TIMERRETRY;
+			q->queued++;
+			pushTimer(q, net->adj.dueAt[e], i, e);
+		}
+		return;
+	}
+	net->adj.sentVersion[e] = net->routers[i].version;
+	net->adj.sentAt[e] = now;
+	settleDirty(net, i);
+}
+
+/* advertiseTable()
+ *
+ * Triggered update: sends each neighbor of router i only the routes that
+ * changed since router i last advertised to it. Neighbors that are already up
+ * to date get nothing. A neighbor updated less than the triggered gap ago
+ * gets one update when the gap is up, covering every change made meanwhile.
+ */
+void advertiseTable(struct network *net, int i)
+{
+	struct timerQueue *q = &net->timers;
+	unsigned int version = net->routers[i].version;
+	long long now = clockUsec(net);
+	int e;
+
+	for (e = net->adj.offsets[i]; e < net->adj.offsets[i + 1]; e++) {
+		if (net->adj.sentVersion[e] == version || net->adj.costs[e] == INT_MAX || net->adj.dueAt[e] != 0)
+			continue;
+		if (now - net->adj.sentAt[e] >= q->gap) {
+			sendUpdate(net, i, e, 0, now);
+		} else {
+			net->adj.dueAt[e] = net->adj.sentAt[e] + q->gap;
+			q->queued++;
+			pushTimer(q, net->adj.dueAt[e], i, e);
+		}
+	}
+	net->transport->flush(net);
+}
+
+/* nextJitter()
+ *
+ * Returns a uniform number in [0, 1) from the queue's own splitmix64 state.
+ * Each worker draws from its own, so none contend for rand()'s lock and a
+ * worker's jitter does not depend on how the others interleave.
+ */
+double nextJitter(struct timerQueue *q)
+{
+	uint64_t z = (q->jitter += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return ((z ^ (z >> 31)) >> 11) / 9007199254740992.0;
+}
+
+/* periodicUpdate()
+ *
+ * Sends router i's full table to every neighbor and schedules its next full
+ * update a period later, less a random jitter so routers do not fall into
+ * step. Updates already coalesced for a link stay queued.
+ */
+void periodicUpdate(struct network *net, int i, long long now)
+{
+	struct timerQueue *q = &net->timers;
+	int e;
+
+	for (e = net->adj.offsets[i]; e < net->adj.offsets[i + 1]; e++) {
+		if (net->adj.costs[e] == INT_MAX)
+			continue;
+		net->adj.sentVersion[e] = 0;
+		sendUpdate(net, i, e, DVFLAGPERIODIC, now);
+	}
+	pushTimer(q, now + (long long) (q->period * (1 - PERIODICJITTER * nextJitter(q))), i, -1);
+}
+
+/* startTimers()
+ *
+ * Schedules the first full update of every router this loop owns at a random
+ * point within one period, with nothing coalesced yet.
+ */
+void startTimers(struct network *net, long long period, long long gap)
+{
+	struct timerQueue *q = &net->timers;
+	long long now = clockUsec(net);
+	int first = net->adj.offsets[net->firstRouter], last = net->adj.offsets[net->lastRouter];
+	int i;
+
+	// a simulation plays out the same under the same seed; each loop's first router sets it apart
+	q->jitter = (net->sim != NULL ? net->sim->seed : (uint64_t) getpid() ^ (uint64_t) now)
+		^ (uint64_t) net->firstRouter << 32;
+	q->count = 0;
+	q->period = period;
+	q->gap = gap;
+	q->queued = 0;
+	q->lastActivity = now;
+	memset(net->adj.sentAt + first, 0, (last - first) * sizeof(long long));
+	memset(net->adj.dueAt + first, 0, (last - first) * sizeof(long long));
+	for (i = net->firstRouter; i < net->lastRouter; i++)
+		pushTimer(q, now + (long long) (period * nextJitter(q)), i, -1);
+}
+
+/* pushTask()
+ *
+ * Queues router r at the tail of a queue. Only its owner pushes.
+ */
+void pushTask(struct taskQueue *q, int r)
+{
+	long long t = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&q->tasks[t & q->mask], r, __ATOMIC_RELAXED);
+	__atomic_store_n(&q->tail, t + 1, __ATOMIC_RELEASE);
+}
+
+/* takeTask()
+ *
+ * Takes the router queued longest on a queue, the worker's own or another's.
+ * Returns -1 if there is none or another worker got there first.
+ */
+int takeTask(struct taskQueue *q)
+{
+	long long h = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE), t;
+	int r;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	t = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+	if (h >= t)
+		return -1;
+	r = __atomic_load_n(&q->tasks[h & q->mask], __ATOMIC_RELAXED);
+	if (!__atomic_compare_exchange_n(&q->head, &h, h + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		return -1;
+	return r;
+}
+
+/* acquireRouter()
+ *
+ * Takes router i for the calling worker if no worker is running or has
+ * queued it. Always succeeds without workers.
+ */
+bool acquireRouter(struct network *net, int i)
+{
+	int idle = ROUTERIDLE;
+
+	return net->taskState == NULL
+		|| __atomic_compare_exchange_n(&net->taskState[i], &idle, ROUTERRUNNING, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+/* releaseRouter()
+ *
+ * Hands router i back, queueing it on this worker's queue again if again is
+ * set or its socket became readable while it ran.
+ */
+void releaseRouter(struct network *net, int i, bool again)
+{
+	int running = ROUTERRUNNING;
+
+	if (net->taskState == NULL)
+		return;
+	if (!again && __atomic_compare_exchange_n(&net->taskState[i], &running, ROUTERIDLE, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		return;
+	__atomic_store_n(&net->taskState[i], ROUTERQUEUED, __ATOMIC_RELEASE);
+	pushTask(net->tasks, i);
+}
+
+/* notifyRouter()
+ *
+ * Router i's socket became readable: queues it on this worker's queue, or if
+ * a worker is running it, has it queued again once it finishes.
+ */
+void notifyRouter(struct network *net, int i)
+{
+	int state = __atomic_load_n(&net->taskState[i], __ATOMIC_ACQUIRE);
+
+	while (state == ROUTERIDLE || state == ROUTERRUNNING) {
+		int next = state == ROUTERIDLE ? ROUTERQUEUED : ROUTERNOTIFIED;
+		if (__atomic_compare_exchange_n(&net->taskState[i], &state, next, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			if (next == ROUTERQUEUED)
+				pushTask(net->tasks, i);
+			return;
+		}
+	}
+}
+
+/* wakeRouter()
+ *
+ * Has router i run soon to pick up what was just put in its mailboxes: on
+ * the backlog without workers, as a task with them. A worker queues the
+ * routers it woke when it next gathers its readable sockets, as if the DVs
+ * had gone over UDP, so each takes in everything sent to it meanwhile.
+ */
+void wakeRouter(struct network *net, int i)
+{
+	struct router *r = &net->routers[i];
+
+	if (net->taskState != NULL) {
+		if (net->wokenRouters == NULL) {
+			notifyRouter(net, i);
+		} else if (!net->isWoken[i]) {
+			net->isWoken[i] = true;
+			net->wokenRouters[net->numWoken++] = i;
+		}
+	} else if (!r->backlogged) {
+		r->backlogged = true;
+		net->backlog[net->numBacklogged++] = i;
+	}
+}
+
+/* mailboxBuffer()
+ *
+ * Returns the free slot router i's next DV over link e goes straight into,
+ * or NULL if the neighbor has not emptied any yet.
+ */
+unsigned char *mailboxBuffer(struct network *net, int i, int e)
+{
+	struct mailbox *mb = &net->mailboxes[e];
+	unsigned int head = mb->head;
+
+	(void) i;
+	if (head - __atomic_load_n(&mb->tail, __ATOMIC_ACQUIRE) == MAILBOXSLOTS)
+		return NULL;
+	return net->mailboxSlots + ((size_t) e * MAILBOXSLOTS + (head & (MAILBOXSLOTS - 1))) * DVMAXDATAGRAM;
+}
+
+/* mailboxSend()
+ *
+ * Publishes the len bytes router i just wrote to mailboxBuffer() and wakes
+ * the neighbor.
+ */
+void mailboxSend(struct network *net, int i, int e, size_t len)
+{
+	struct mailbox *mb = &net->mailboxes[e];
+
+	(void) i;
+	net->stats.datagramsSent++;
+	net->stats.bytesSent += len;
+	mb->lens[mb->head & (MAILBOXSLOTS - 1)] = (unsigned short) len;
+	__atomic_store_n(&mb->head, mb->head + 1, __ATOMIC_RELEASE);
+	wakeRouter(net, net->adj.neighbors[e]);
+}
+
+/* mailboxFlush()
+ *
+ * Nothing is ever queued.
+ */
+void mailboxFlush(struct network *net)
+{
+	(void) net;
+}
+
+/* mailboxRelease()
+ *
+ * Hands the slots router i's last receive took back to their senders.
+ */
+void mailboxRelease(struct network *net, int i)
+{
+	int k;
+
+	(void) i;
+	for (k = 0; k < net->numHeld; k++) {
+		struct mailbox *mb = &net->mailboxes[net->held[k]];
+		__atomic_store_n(&mb->tail, mb->tail + mb->taken, __ATOMIC_RELEASE);
+		mb->taken = 0;
+	}
+	net->numHeld = 0;
+}
+
+/* mailboxReceive()
+ *
+ * Frees the slots of router i's last receive, then points bufs and lens
+ * at up to IOBATCH DVs still waiting in its incoming mailboxes, in place.
+ * Returns how many there are, 0 if none.
+ */
+int mailboxReceive(struct network *net, int i, unsigned char **bufs, size_t *lens)
+{
+	int n = 0, k;
+
+	mailboxRelease(net, i);
+	for (k = net->inOffsets[i]; k < net->inOffsets[i + 1] && n < IOBATCH; k++) {
+		int e = net->inLinks[k];
+		struct mailbox *mb = &net->mailboxes[e];
+		unsigned int tail = mb->tail, head = __atomic_load_n(&mb->head, __ATOMIC_ACQUIRE);
+
+		if (head == tail)
+			continue;
+		for (; tail != head && n < IOBATCH; tail++, n++) {
+			bufs[n] = net->mailboxSlots + ((size_t) e * MAILBOXSLOTS + (tail & (MAILBOXSLOTS - 1))) * DVMAXDATAGRAM;
+			lens[n] = mb->lens[tail & (MAILBOXSLOTS - 1)];
+		}
+		mb->taken = tail - mb->tail;
+		net->held[net->numHeld++] = e;
+	}
+	return n;
+}
+
+/* mailboxKick()
+ *
+ * Has router i advertise its table. Before the workers start, that means
+ * queueing it on its home worker's queue.
+ */
+void mailboxKick(struct network *net, int i)
+{
+	int k;
+
+	for (k = 0; k < net->numWorkers; k++) {
+		struct worker *w = &net->workers[k];
+		if (i >= w->net.firstRouter && i < w->net.lastRouter) {
+			net->taskState[i] = ROUTERQUEUED;
+			pushTask(&w->tasks, i);
+			return;
+		}
+	}
+	wakeRouter(net, i);
+}
+
+/* openMailboxes()
+ *
+ * Sets up the in-process transport: a mailbox per link and, for each router,
+ * the list of links into it. The slots are reserved up front but only take
+ * memory once used.
+ */
+void openMailboxes(struct network *net)
+{
+	int n = net->numRouters, m = net->adj.offsets[n];
+	int i, e;
+
+	if ((net->mailboxes = aligned_alloc(ARENAALIGN, max(m, 1) * sizeof(struct mailbox))) == NULL
+			|| (net->inOffsets = calloc(n + 1, sizeof(int))) == NULL
+			|| (net->inLinks = malloc(max(m, 1) * sizeof(int))) == NULL)
+		error("Error allocating mailboxes");
+	memset(net->mailboxes, 0, max(m, 1) * sizeof(struct mailbox));
+	net->mailboxSlots = mmap(NULL, (size_t) max(m, 1) * MAILBOXSLOTS * DVMAXDATAGRAM, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (net->mailboxSlots == MAP_FAILED)
+		error("Error allocating mailboxes");
+	net->numHeld = 0;
+
+	// counting sort of the links by the router they lead to
+	for (e = 0; e < m; e++)
+		net->inOffsets[net->adj.neighbors[e] + 1]++;
+	for (i = 0; i < n; i++)
+		net->inOffsets[i + 1] += net->inOffsets[i];
+	for (i = 0; i < n; i++) {
+		for (e = net->adj.offsets[i]; e < net->adj.offsets[i + 1]; e++)
+			net->inLinks[net->inOffsets[net->adj.neighbors[e]]++] = e;
+	}
+	for (i = n; i > 0; i--)
+		net->inOffsets[i] = net->inOffsets[i - 1];
+	net->inOffsets[0] = 0;
+}
+
+/* closeMailboxes()
+ *
+ * Releases what openMailboxes() set up.
+ */
+void closeMailboxes(struct network *net)
+{
+	munmap(net->mailboxSlots, (size_t) max(net->adj.offsets[net->numRouters], 1) * MAILBOXSLOTS * DVMAXDATAGRAM);
+	free(net->mailboxes);
+	free(net->inOffsets);
+	free(net->inLinks);
+}
+
+/* pushEvent()
+ *
+ * Puts event ev in flight, due at virtual time at.
+ */
+void pushEvent(struct simulation *s, struct simEvent *ev, long long at)
+{
+	struct simPending p;
+	int k;
+
+	if (s->count == s->capacity) {
+		s->capacity = max(2 * s->capacity, 64);
+		if ((s->heap = realloc(s->heap, s->capacity * sizeof(struct simPending))) == NULL)
+			error("Error allocating simulator events");
+	}
+	p.at = at;
+	p.seq = s->sent++;
+	p.ev = ev;
+	for (k = s->count++; k > 0; k = (k - 1) / 2) {
+		struct simPending *parent = &s->heap[(k - 1) / 2];
+		if (parent->at < p.at || (parent->at == p.at && parent->seq < p.seq))
+			break;
+		s->heap[k] = *parent;
+	}
+	s->heap[k] = p;
+}
+
+/* popEvent()
+ *
+ * Takes the earliest DV in flight, the first sent among those due at once.
+ */
+struct simEvent *popEvent(struct simulation *s)
+{
+	struct simEvent *ev = s->heap[0].ev;
+	struct simPending last = s->heap[--s->count];
+	int k = 0, child;
+
+	while ((child = 2 * k + 1) < s->count) {
+		struct simPending *c = &s->heap[child];
+		if (child + 1 < s->count && (c[1].at < c->at || (c[1].at == c->at && c[1].seq < c->seq)))
+			c = &s->heap[++child];
+		if (last.at < c->at || (last.at == c->at && last.seq < c->seq))
+			break;
+		s->heap[k] = *c;
+		k = child;
+	}
+	s->heap[k] = last;
+	return ev;
+}
+
+/* takeEvent()
+ *
+ * Returns a spent event to reuse, allocating another slab of them if there
+ * are none.
+ */
+struct simEvent *takeEvent(struct simulation *s)
+{
+	struct simEvent *ev;
+	int k;
+
+	if (s->free == NULL) {
+		struct simSlab *slab = malloc(sizeof(struct simSlab));
+		if (slab == NULL)
+			error("Error allocating simulator events");
+		slab->next = s->slabs;
+		s->slabs = slab;
+		for (k = 0; k < SIMSLAB; k++) {
+			slab->events[k].next = s->free;
+			s->free = &slab->events[k];
+		}
+	}
+	ev = s->free;
+	s->free = ev->next;
+	return ev;
+}
+
+/* sendEvent()
+ *
+ * Puts event ev, holding a DV of len bytes, in flight to router. It is due
+ * delay usecs from now, rounded up to the next SIMTICK: routers look at
+ * their inboxes once a tick, as a real one drains its socket once a poll,
+ * so DVs arriving within one tick are handled together. The rounding never
+ * reorders DVs over one link.
+ */
+void sendEvent(struct network *net, struct simEvent *ev, int router, long long delay, size_t len)
+{
+	struct simulation *s = net->sim;
+
+	ev->router = router;
+	ev->len = len;
+	pushEvent(s, ev, (s->now + delay + SIMTICK - 1) / SIMTICK * SIMTICK);
+}
+
+/* simBuffer()
+ *
+ * Returns the data of the event router i writes its next DV into, so it is
+ * put in flight without a copy. A link never fills up.
+ */
+unsigned char *simBuffer(struct network *net, int i, int e)
+{
+	struct simulation *s = net->sim;
+
+	(void) i;
+	(void) e;
+	if (s->writing == NULL)
+		s->writing = takeEvent(s);
+	return s->writing->data;
+}
+
+/* simSend()
+ *
+ * Puts the DV router i just wrote in flight over link e.
+ */
+void simSend(struct network *net, int i, int e, size_t len)
+{
+	struct simulation *s = net->sim;
+
+	(void) i;
+	net->stats.datagramsSent++;
+	net->stats.bytesSent += len;
+	sendEvent(net, s->writing, net->adj.neighbors[e], s->delays[e], len);
+	s->writing = NULL;
+}
+
+/* simFlush()
+ *
+ * Nothing is ever queued.
+ */
+void simFlush(struct network *net)
+{
+	(void) net;
+}
+
+/* simRelease()
+ *
+ * Puts the DVs router i's last receive took back on the free list.
+ */
+void simRelease(struct network *net, int i)
+{
+	struct simulation *s = net->sim;
+	struct simEvent *ev;
+
+	(void) i;
+	while ((ev = s->held) != NULL) {
+		s->held = ev->next;
+		ev->next = s->free;
+		s->free = ev;
+	}
+}
+
+/* simReceive()
+ *
+ * Points bufs and lens at up to IOBATCH of the DVs delivered to router i,
+ * in the order they arrived. They stay held until simRelease(). Returns how
+ * many there are, 0 if none.
+ */
+int simReceive(struct network *net, int i, unsigned char **bufs, size_t *lens)
+{
+	struct simulation *s = net->sim;
+	struct simEvent *ev;
+	int n;
+
+	net->stats.receiveCalls++;
+	for (n = 0; n < IOBATCH && (ev = s->inHead[i]) != NULL; n++) {
+		s->inHead[i] = ev->next;
+		ev->next = s->held;
+		s->held = ev;
+		bufs[n] = ev->data;
+		lens[n] = ev->len;
+	}
+	return n;
+}
+
+/* simKick()
+ *
+ * Has router i send a DV to itself, delivered at the next tick, which it
+ * relaxes against and advertises its table after.
+ */
+void simKick(struct network *net, int i)
+{
+	struct simEvent *ev = takeEvent(net->sim);
+	struct dvWriter w;
+
+	beginVector(&w, ev->data, i, net->seq[i]++, 0);
+	addEntry(&w, i, 0);
+	sendEvent(net, ev, i, 0, endVector(&w));
+}
+
+/* openSimulation()
+ *
+ * Sets up the simulator at virtual time 0. Each directed link gets a fixed
+ * delay between delay and twice that, drawn from seed, so DVs sent over one
+ * link arrive in order while different links race.
+ */
+void openSimulation(struct network *net, unsigned int seed, long long delay)
+{
+	int n = net->numRouters, m = net->adj.offsets[n];
+	unsigned long long state = seed * 0x9e3779b97f4a7c15ULL + 1;
+	struct simulation *s;
+	int e;
+
+	if ((s = calloc(1, sizeof(struct simulation))) == NULL
+			|| (s->delays = malloc(max(m, 1) * sizeof(long long))) == NULL
+			|| (s->inHead = calloc(n, sizeof(struct simEvent *))) == NULL
+			|| (s->inTail = calloc(n, sizeof(struct simEvent *))) == NULL
+			|| (s->ready = malloc(n * sizeof(int))) == NULL)
+		error("Error allocating the simulator");
+	s->seed = seed;
+	for (e = 0; e < m; e++) {
+		// xorshift64*, so the delays do not depend on the C library
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		s->delays[e] = delay + (long long) ((state * 0x2545f4914f6cdd1dULL) >> 11) % max(delay, 1);
+	}
+	net->sim = s;
+}
+
+/* closeSimulation()
+ *
+ * Frees the simulator and every DV still in it.
+ */
+void closeSimulation(struct network *net)
+{
+	struct simulation *s = net->sim;
+	struct simSlab *slab;
+
+	while ((slab = s->slabs) != NULL) {
+		s->slabs = slab->next;
+		free(slab);
+	}
+	free(s->heap);
+	free(s->delays);
+	free(s->inHead);
+	free(s->inTail);
+	free(s->ready);
+	free(s);
+	net->sim = NULL;
+}
+
+/* runTimers()
+ *
+ * Fires every timer due by now: periodic full updates, and updates coalesced
+ * while their link's triggered gap ran.
+ */
+void runTimers(struct network *net, long long now)
+{
+	struct timerQueue *q = &net->timers;
+	struct timer t;
+
+	while (q->count > 0 && q->heap[0].due <= now) {
+		popTimer(q, &t);
+		// another worker is running the router: try again shortly
+		if (!acquireRouter(net, t.router)) {
+			pushTimer(q, now + TIMERRETRY, t.router, t.link);
+			continue;
+		}
+		if (t.link < 0) {
+			periodicUpdate(net, t.router, now);
+		} else {
+			net->adj.dueAt[t.link] = 0;
+			q->queued--;
+			if (net->adj.costs[t.link] != INT_MAX)
+				sendUpdate(net, t.router, t.link, 0, now);
+		}
+		releaseRouter(net, t.router, false);
+	}
+	net->transport->flush(net);
+}
+
+/* refreshRouter()
+ *
+ * Sends router i's full table to all of its neighbors again. Nothing is
+ * withdrawn mid-flight by now, so it may take any neighbor's route again.
+ */
+void refreshRouter(struct network *net, int i)
+{
+	int first = net->adj.offsets[i], last = net->adj.offsets[i + 1];
+
+	memcpy(net->routers[i].feasibleCosts, net->routers[i].costs, net->numRouters * sizeof(int));
+	memset(net->adj.sentVersion + first, 0, (last - first) * sizeof(unsigned int));
+	advertiseTable(net, i);
+}
+
+/* refreshTables()
+ *
+ * Refreshes every router this loop owns.
+ */
+void refreshTables(struct network *net)
+{
+	int i;
+
+	for (i = net->firstRouter; i < net->lastRouter; i++)
+		refreshRouter(net, i);
+}
+
+/* killRouter()
+ *
+ * Takes router k down: every link to or from it goes dead, and each neighbor
+ * makes the routes it had through k unreachable and advertises the loss.
+ * Routers left without a route pick up alternatives from the next full
+ * exchange. Only the routers this loop owns are touched, so each worker
+ * carries out its own share.
+ */
+void killRouter(struct network *net, int k)
+{
+	int i, d, e;
+
+	if (k >= net->firstRouter && k < net->lastRouter) {
+		net->killed[k] = true;
+		resetTable(net, k);
+	}
+	for (i = net->firstRouter; i < net->lastRouter; i++) {
+		struct router *table = &net->routers[i];
+		bool isNeighbor = false;
+
+		for (e = net->adj.offsets[i]; e < net->adj.offsets[i + 1]; e++) {
+			if (i == k || net->adj.neighbors[e] == k) {
+				isNeighbor = isNeighbor || i != k;
+				net->adj.costs[e] = INT_MAX;
+			}
+		}
+		if (!isNeighbor)
+			continue;
+
+		table->version++;
+		for (d=0; d<net->numRouters; d++) {
+			if (table->nextHop[d] == k)
+				setRoute(net, table, d, INT_MAX, -1);
+		}
+		outputTable(net, table, false);
+		// synchronous rounds send nothing
+		if (net->transport != NULL)
+			advertiseTable(net, i);
+	}
+}
+
+/* udpReceive()
+ *
+ * Receives whatever is queued on router i's socket without blocking, up to
+ * IOBATCH datagrams with one recvmmsg, or one with recvfrom without
+ * batching. Points bufs and lens at the datagrams and returns how many there
+ * are, 0 if none.
+ */
+int udpReceive(struct network *net, int i, unsigned char **bufs, size_t *lens)
+{
+	struct ioBatch *b = &net->in;
+	ssize_t len;
+	int n, k;
+
+	net->stats.receiveCalls++;
+	if (!net->batched) {
+		if ((len = recvfrom(net->sockfd[i], net->buf, DVMAXDATAGRAM, MSG_DONTWAIT, NULL, NULL)) < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			error("Error receiving datagram from client\n");
+		}
+		bufs[0] = net->buf;
+		lens[0] = len;
+		return 1;
+	}
+
+	for (k = 0; k < IOBATCH; k++)
+		b->iovs[k].iov_len = DVMAXDATAGRAM;
+	if ((n = recvmmsg(net->sockfd[i], b->msgs, IOBATCH, MSG_DONTWAIT, NULL)) < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		if (errno != ENOSYS)
+			error("Error receiving datagram from client\n");
+		// no recvmmsg in this kernel: fall back to recvfrom
+		net->batched = false;
+		return udpReceive(net, i, bufs, lens);
+	}
+	for (k = 0; k < n; k++) {
+		bufs[k] = b->bufs + k * DVMAXDATAGRAM;
+		lens[k] = b->msgs[k].msg_len;
+	}
+	return n;
+}
+
+/* udpRelease()
+ *
+ * Received datagrams are overwritten by the next receive anyway.
+ */
+void udpRelease(struct network *net, int i)
+{
+	(void) net;
+	(void) i;
+}
+
+/* reserveDrain()
+ *
+ * Makes room for one more drained vector of up to a datagram's worth of
+ * entries. The drain buffers live outside the arena since bursts decide
+ * their size.
+ */
+void reserveDrain(struct drain *d)
+{
+	int entries = d->numEntries + DVMAXDATAGRAM / 2;
+
+	if (d->numVectors == d->maxVectors) {
+		d->maxVectors = max(2 * d->maxVectors, IOBATCH);
+		if ((d->vectors = realloc(d->vectors, d->maxVectors * sizeof(struct drainedVector))) == NULL)
+			error("Error allocating drain");
+	}
+	if (entries > d->maxEntries) {
+		d->maxEntries = max(2 * d->maxEntries, entries);
+		if ((d->dests = realloc(d->dests, d->maxEntries * sizeof(int))) == NULL
+				|| (d->costs = realloc(d->costs, d->maxEntries * sizeof(int))) == NULL)
+			error("Error allocating drain");
+	}
+}
+
+/* compareDrained()
+ *
+ * Orders drained vectors by sender, then oldest first by sequence number,
+ * allowing for wraparound.
+ */
+int compareDrained(const void *a, const void *b)
+{
+	const struct drainedVector *x = a, *y = b;
+
+	if (x->sender != y->sender)
+		return x->sender < y->sender ? -1 : 1;
+	if (x->seq == y->seq)
+		return 0;
+	return (int) (x->seq - y->seq) < 0 ? -1 : 1;
+}
+
+/* addDrained()
+ *
+ * Decodes one received datagram into net->drain. Malformed ones are dropped.
+ */
+void addDrained(struct network *net, const unsigned char *buf, size_t len)
+{
+	struct drain *d = &net->drain;
+	struct distanceVector dv;
+
+	reserveDrain(d);
+	dv.dests = d->dests + d->numEntries;
+	dv.costs = d->costs + d->numEntries;
+	if (!decodeVector(net, buf, len, &dv))
+		return;
+	d->vectors[d->numVectors].sender = dv.sender;
+	d->vectors[d->numVectors].seq = dv.seq;
+	d->vectors[d->numVectors].flags = dv.flags;
+	d->vectors[d->numVectors].first = d->numEntries;
+	d->vectors[d->numVectors].count = dv.count;
+	d->numVectors++;
+	d->numEntries += dv.count;
+}
+
+/* drainSocket()
+ *
+ * Receives and decodes the DVs queued on router i's socket, up to
+ * DRAINBATCHES batches, into net->drain. Returns how many datagrams were
+ * received.
+ */
+int drainSocket(struct network *net, int i)
+{
+	struct drain *d = &net->drain;
+	unsigned char *bufs[IOBATCH];
+	size_t lens[IOBATCH];
+	int received = 0, batches, n, k;
+
+	d->numVectors = 0;
+	d->numEntries = 0;
+	d->more = false;
+	for (batches = 0; batches < DRAINBATCHES; batches++) {
+		if ((n = net->transport->receive(net, i, bufs, lens)) == 0)
+			break;
+		d->more = batches == DRAINBATCHES - 1;
+		received += n;
+		for (k = 0; k < n; k++)
+			addDrained(net, bufs[k], lens[k]);
+		// a short batch already emptied the socket
+		if (net->batched && n < IOBATCH)
+			break;
+	}
+	net->transport->release(net, i);
+	return received;
+}
+
+/* relaxDrained()
+ *
+ * Merges each sender's DVs in net->drain into one, newer sequence numbers
+ * overriding older ones destination by destination, since a DV only carries
+ * what changed. Router i's table is then relaxed once per sender, and
+ * whatever changed is logged and advertised once. Returns true if the table
+ * changed.
+ */
+bool relaxDrained(struct network *net, int i)
+{
+	struct drain *d = &net->drain;
+	struct distanceVector *rcvd = &net->rcvd;
+	bool isChanged = false, isTriggered = false;
+	int k, v, first;
+
+	// a killed router stays silent
+	if (net->killed[i])
+		return false;
+
+	qsort(d->vectors, d->numVectors, sizeof(struct drainedVector), compareDrained);
+	for (first = 0; first < d->numVectors; first = v) {
+		rcvd->sender = d->vectors[first].sender;
+		rcvd->count = 0;
+		for (v = first; v < d->numVectors && d->vectors[v].sender == rcvd->sender; v++) {
+			struct drainedVector *dv = &d->vectors[v];
+			isTriggered = isTriggered || !(dv->flags & DVFLAGPERIODIC);
+			for (k = dv->first; k < dv->first + dv->count; k++) {
+				int dest = d->dests[k];
+				if (d->slot[dest] < 0) {
+					d->slot[dest] = rcvd->count;
+					rcvd->dests[rcvd->count++] = dest;
+				}
+				rcvd->costs[d->slot[dest]] = d->costs[k];
+			}
+		}
+		for (k = 0; k < rcvd->count; k++)
+			d->slot[rcvd->dests[k]] = -1;
+
+		isChanged = updateTable(net, &net->routers[i], rcvd, isChanged);
+	}
+	if (isChanged)
+		outputTable(net, &net->routers[i], false);
+	// periodic updates keep coming after convergence, so only count them when they teach something
+	if (isChanged || isTriggered)
+		net->timers.lastActivity = clockUsec(net);
+
+	advertiseTable(net, i);
+	return isChanged;
+}
+
+/* handleDatagram()
+ *
+ * Drains the DVs queued on router i's socket and relaxes router i's table
+ * against them. Returns true if the table changed.
+ */
+bool handleDatagram(struct network *net, int i)
+{
+	net->stats.datagramsReceived += drainSocket(net, i);
+	return relaxDrained(net, i);
+}
+
+/* compareCompletions()
+ *
+ * Orders reaped receives by router.
+ */
+int compareCompletions(const void *a, const void *b)
+{
+	const struct completion *x = a, *y = b;
+
+	return (x->router > y->router) - (x->router < y->router);
+}
+
+/* uringPoll()
+ *
+ * The io_uring counterpart of pollSockets(): waits up to timeout usecs for
+ * receives unless some are already reaped, then handles them router by
+ * router, handing each buffer back once decoded. Receives reaped meanwhile,
+ * while advertising, wait for the next call. Returns how many tables changed.
+ */
+int uringPoll(struct network *net, long long timeout)
+{
+	struct uring *u = &net->uring;
+	struct completion *swap;
+	int changes = 0, numHandling, first, k;
+
+	if (u->numReady == 0) {
+		uringEnter(net, 1, timeout);
+		net->stats.receiveCalls++;
+	}
+	uringReap(net);
+
+	swap = u->handling;
+	u->handling = u->ready;
+	u->ready = swap;
+	numHandling = u->numReady;
+	u->numReady = 0;
+
+	qsort(u->handling, numHandling, sizeof(struct completion), compareCompletions);
+	for (first = 0; first < numHandling; first = k) {
+		int i = u->handling[first].router;
+
+		net->drain.numVectors = 0;
+		net->drain.numEntries = 0;
+		for (k = first; k < numHandling && u->handling[k].router == i; k++) {
+			addDrained(net, u->bufs + (size_t) u->handling[k].bid * DVMAXDATAGRAM, u->handling[k].len);
+			uringRecycle(net, u->handling[k].bid);
+		}
+		net->stats.datagramsReceived += k - first;
+		changes += relaxDrained(net, i);
+	}
+	uringRearm(net);
+	return changes;
+}
+
+/* uringDiscard()
+ *
+ * Throws away every receive reaped or waiting in the ring, once the sends
+ * still in flight have landed.
+ */
+void uringDiscard(struct network *net)
+{
+	struct uring *u = &net->uring;
+	int k;
+
+	uringEnter(net, 0, -1);
+	uringReap(net);
+	while (u->sendsInFlight > 0) {
+		uringEnter(net, 1, -1);
+		uringReap(net);
+	}
+	for (k = 0; k < u->numReady; k++)
+		uringRecycle(net, u->ready[k].bid);
+	u->numReady = 0;
+	uringRearm(net);
+}
+
+/* serviceRouter()
+ *
+ * The one handler every socket event dispatches to: handles router r's DVs
+ * and, since edge-triggered readiness is not reported again for DVs left
+ * behind by a capped drain, backlogs r to be serviced again. Returns true if
+ * r's table changed.
+ */
+bool serviceRouter(struct network *net, struct router *r)
+{
+	bool isChanged = handleDatagram(net, r->index);
+
+	if (net->drain.more && !r->backlogged) {
+		r->backlogged = true;
+		net->backlog[net->numBacklogged++] = r->index;
+	}
+	return isChanged;
+}
+
+/* serviceBacklog()
+ *
+ * Services the first backlogged routers, oldest first; those still
+ * backlogged go to the back. Returns how many tables changed.
+ */
+int serviceBacklog(struct network *net, int backlogged)
+{
+	int changes = 0, k;
+
+	for (k = 0; k < backlogged; k++) {
+		struct router *r = &net->routers[net->backlog[k]];
+		if (!r->backlogged)
+			continue;
+		r->backlogged = false;
+		changes += serviceRouter(net, r);
+	}
+	memmove(net->backlog, net->backlog + backlogged, (net->numBacklogged - backlogged) * sizeof(int));
+	net->numBacklogged -= backlogged;
+	return changes;
+}
+
+/* pollSockets()
+ *
+ * Waits up to timeout usecs for DVs, or not at all while routers are
+ * backlogged, then services every router whose socket became readable and
+ * every router backlogged before the wait. Returns how many tables changed.
+ */
+int pollSockets(struct network *net, long long timeout)
+{
+	struct epoll_event events[EPOLLEVENTS];
+	int backlogged = net->numBacklogged;
+	int changes = 0;
+	int ready, k;
+
+	if (net->ringed)
+		return uringPoll(net, timeout);
+	// round up, so a wait never ends just short of a timer
+	ready = epoll_wait(net->epollfd, events, EPOLLEVENTS, backlogged > 0 ? 0 : (int) ((timeout + 999) / 1000));
+	if (ready < 0) {
+		if (errno != EINTR)
+			error("Error waiting for sockets");
+		return 0;
+	}
+	for (k = 0; k < ready; k++) {
+		// wakefd, which the caller sees to
+		if (events[k].data.ptr == NULL) {
+			net->woken = true;
+			continue;
+		}
+		changes += serviceRouter(net, events[k].data.ptr);
+	}
+	return changes + serviceBacklog(net, backlogged);
+}
+
+/* drainSockets()
+ *
+ * Discards every datagram still queued on the router sockets.
+ */
+void drainSockets(struct network *net)
+{
+	unsigned char *bufs[IOBATCH];
+	size_t lens[IOBATCH];
+	int k;
+
+	if (net->ringed)
+		uringDiscard(net);
+	for (k = 0; k < net->numRouters; k++)
+	{
+		printf("Clearing Router %s's input buffers...", routerName(net, k));
+		while (!net->ringed && net->transport->receive(net, k, bufs, lens) > 0)
+			;
+		net->transport->release(net, k);
+		printf("[OK]\n");
+	}
+}
+
+/* runNetwork()
+ *
+ * Runs the network on this thread until it is stable, starting with the kill
+ * if one is pending. Returns when a table last changed, or started if none did.
+ */
+long long runNetwork(struct network *net, long long started)
+{
+	long long converged = started;
+	bool refreshed = false;
+	int changes = 0;
+
+	if (net->killing >= 0) {
+		killRouter(net, net->killing);
+		net->killing = -1;
+	}
+	net->timers.lastActivity = nowUsec();
+	/* loop: wait for datagram, then relax and advertise the changes */
+	while (1) {
+		// wake for the next timer, or once the network has been quiet for long enough
+		long long now = nowUsec(), wake = net->timers.lastActivity + STABLETIMEOUT;
+		if (net->timers.count > 0 && net->timers.heap[0].due < wake)
+			wake = net->timers.heap[0].due;
+
+		/* receives UDP datagrams from each ready router */
+		int changed = pollSockets(net, max(wake - now, 0));
+		now = nowUsec();
+		if (changed > 0) {
+			changes += changed;
+			converged = now;
+		}
+		runTimers(net, now);
+
+		/* triggered updates are only sent on change, so quiet means
+		 * convergence, unless a dropped update left someone behind or a
+		 * withdrawn route has an alternative nobody re-sent: confirm
+		 * with a full exchange that changes nothing */
+		bool quiet = net->timers.queued == 0 && net->numBacklogged == 0 && net->uring.numReady == 0
+			&& now - net->timers.lastActivity >= STABLETIMEOUT;
+		if (quiet && (changes > 0 || !refreshed)) {
+			refreshTables(net);
+			refreshed = true;
+			changes = 0;
+			net->timers.lastActivity = now;
+		} else if (quiet) {
+			return converged;
+		}
+	}
+}
+
+/* deliverEvents()
+ *
+ * Delivers every DV due by the current virtual time into its router's inbox,
+ * then services the routers delivered to, in the order their first DV
+ * arrived, and the routers backlogged before. Returns how many tables
+ * changed.
+ */
+int deliverEvents(struct network *net)
+{
+	struct simulation *s = net->sim;
+	int backlogged = net->numBacklogged;
+	int changes = 0, count = 0, k;
+
+	while (s->count > 0 && s->heap[0].at <= s->now) {
+		struct simEvent *ev = popEvent(s);
+		int i = ev->router;
+
+		ev->next = NULL;
+		if (s->inHead[i] == NULL) {
+			s->inHead[i] = ev;
+			// a router with DVs left over is backlogged already
+			if (!net->routers[i].backlogged)
+				s->ready[count++] = i;
+		} else {
+			s->inTail[i]->next = ev;
+		}
+		s->inTail[i] = ev;
+		s->delivered++;
+	}
+	for (k = 0; k < count; k++)
+		changes += serviceRouter(net, &net->routers[s->ready[k]]);
+	return changes + serviceBacklog(net, backlogged);
+}
+
+/* runSimulation()
+ *
+ * Runs the simulated network until it is stable, starting with the kill if
+ * one is pending. Virtual time jumps to the next DV or timer due, whichever
+ * comes first, and the network is quiet the moment no DV is in flight and
+ * no update is waiting. Returns the virtual time a table last changed, or
+ * started if none did.
+ */
+long long runSimulation(struct network *net, long long started)
+{
+	struct simulation *s = net->sim;
+	long long converged = started;
+	bool refreshed = false;
+	int changes = 0;
+
+	if (net->killing >= 0) {
+		killRouter(net, net->killing);
+		net->killing = -1;
+	}
+	while (1) {
+		int changed = 0;
+
+		if (s->count == 0 && net->timers.queued == 0 && net->numBacklogged == 0) {
+			// confirm with a full exchange that changes nothing, as runNetwork() does
+			if (changes == 0 && refreshed)
+				return converged;
+			refreshTables(net);
+			refreshed = true;
+			changes = 0;
+			continue;
+		}
+		if (net->numBacklogged > 0) {
+			changed = deliverEvents(net);
+		} else if (s->count > 0 && (net->timers.count == 0 || s->heap[0].at <= net->timers.heap[0].due)) {
+			s->now = s->heap[0].at;
+			changed = deliverEvents(net);
+		} else {
+			s->now = net->timers.heap[0].due;
+			runTimers(net, s->now);
+		}
+		if (changed > 0) {
+			changes += changed;
+			converged = s->now;
+			s->settled = nowUsec();
+		}
+	}
+}
+
+/* relaxTail()
+ *
+ * Min-plus relaxation of destinations from .. n - 1: wherever theirs, over
+ * a link of the given cost, is cheaper than costs, costs takes it, hops
+ * takes neighbor and the destination's bit is set in changed. The sum
+ * saturates at INT_MAX, so unreachable stays unreachable.
+ */
+void relaxTail(int *costs, int *hops, const int *theirs, int link, int neighbor, int from, int n,
+	unsigned long long *changed)
+{
+	int limit = INT_MAX - link;
+	int d;
+
+	for (d = from; d < n; d++) {
+		int cost = min(theirs[d], limit) + link;
+		if (cost < costs[d]) {
+			costs[d] = cost;
+			hops[d] = neighbor;
+			changed[d / 64] |= 1ULL << (d % 64);
+		}
+	}
+}
+
+/* relaxScalar()
+ *
+ * relaxTail() over the whole vector, for CPUs without SSE4.1.
+ */
+void relaxScalar(int *costs, int *hops, const int *theirs, int link, int neighbor, int n,
+	unsigned long long *changed)
+{
+	relaxTail(costs, hops, theirs, link, neighbor, 0, n, changed);
+}
+
+/* relaxSSE4()
+ *
+ * relaxTail() four destinations at a time.
+ */
+__attribute__((target("sse4.1")))
+void relaxSSE4(int *costs, int *hops, const int *theirs, int link, int neighbor, int n,
+	unsigned long long *changed)
+{
+	__m128i limit = _mm_set1_epi32(INT_MAX - link), add = _mm_set1_epi32(link), via = _mm_set1_epi32(neighbor);
+	int d;
+
+	for (d = 0; d + 4 <= n; d += 4) {
+		__m128i cost = _mm_add_epi32(_mm_min_epi32(_mm_loadu_si128((const __m128i *) (theirs + d)), limit), add);
+		__m128i curr = _mm_loadu_si128((const __m128i *) (costs + d));
+		__m128i better = _mm_cmpgt_epi32(curr, cost);
+		int bits = _mm_movemask_ps(_mm_castsi128_ps(better));
+
+		if (bits == 0)
+			continue;
+		_mm_storeu_si128((__m128i *) (costs + d), _mm_min_epi32(curr, cost));
+		_mm_storeu_si128((__m128i *) (hops + d),
+			_mm_blendv_epi8(_mm_loadu_si128((const __m128i *) (hops + d)), via, better));
+		changed[d / 64] |= (unsigned long long) bits << (d % 64);
+	}
+	relaxTail(costs, hops, theirs, link, neighbor, d, n, changed);
+}
+
+/* relaxAVX2()
+ *
+ * relaxTail() eight destinations at a time.
+ */
+__attribute__((target("avx2")))
+void relaxAVX2(int *costs, int *hops, const int *theirs, int link, int neighbor, int n,
+	unsigned long long *changed)
+{
+	__m256i limit = _mm256_set1_epi32(INT_MAX - link), add = _mm256_set1_epi32(link), via = _mm256_set1_epi32(neighbor);
+	int d;
+
+	for (d = 0; d + 8 <= n; d += 8) {
+		__m256i cost = _mm256_add_epi32(_mm256_min_epi32(_mm256_loadu_si256((const __m256i *) (theirs + d)), limit), add);
+		__m256i curr = _mm256_loadu_si256((const __m256i *) (costs + d));
+		__m256i better = _mm256_cmpgt_epi32(curr, cost);
+		int bits = _mm256_movemask_ps(_mm256_castsi256_ps(better));
+
+		if (bits == 0)
+			continue;
+		_mm256_storeu_si256((__m256i *) (costs + d), _mm256_min_epi32(curr, cost));
+		_mm256_storeu_si256((__m256i *) (hops + d),
+			_mm256_blendv_epi8(_mm256_loadu_si256((const __m256i *) (hops + d)), via, better));
+		changed[d / 64] |= (unsigned long long) bits << (d % 64);
+	}
+	relaxTail(costs, hops, theirs, link, neighbor, d, n, changed);
+}
+
+/* relaxAVX512()
+ *
+ * relaxTail() sixteen destinations at a time, storing through the mask of
+ * those that improved.
+ */
+__attribute__((target("avx512f")))
+void relaxAVX512(int *costs, int *hops, const int *theirs, int link, int neighbor, int n,
+	unsigned long long *changed)
+{
+	__m512i limit = _mm512_set1_epi32(INT_MAX - link), add = _mm512_set1_epi32(link), via = _mm512_set1_epi32(neighbor);
+	int d;
+
+	for (d = 0; d + 16 <= n; d += 16) {
+		__m512i cost = _mm512_add_epi32(_mm512_min_epi32(_mm512_loadu_si512(theirs + d), limit), add);
+		__mmask16 better = _mm512_cmplt_epi32_mask(cost, _mm512_loadu_si512(costs + d));
+
+		if (better == 0)
+			continue;
+		_mm512_mask_storeu_epi32(costs + d, better, cost);
+		_mm512_mask_storeu_epi32(hops + d, better, via);
+		changed[d / 64] |= (unsigned long long) better << (d % 64);
+	}
+	relaxTail(costs, hops, theirs, link, neighbor, d, n, changed);
+}
+
+/* relaxNarrowTail()
+ *
+ * relaxTail() over 16-bit costs, where the sum saturates at USHRT_MAX.
+ * link is at most USHRT_MAX.
+ */
+void relaxNarrowTail(unsigned short *costs, int *hops, const unsigned short *theirs, int link, int neighbor,
+	int from, int n, unsigned long long *changed)
+{
+	int d;
+
+	for (d = from; d < n; d++) {
+		int cost = min(theirs[d] + link, USHRT_MAX);
+		if (cost < costs[d]) {
+			costs[d] = (unsigned short) cost;
+			hops[d] = neighbor;
+			changed[d / 64] |= 1ULL << (d % 64);
+		}
+	}
+}
+
+/* relaxNarrowScalar()
+ *
+ * relaxNarrowTail() over the whole vector, for CPUs without SSE4.1.
+ */
+void relaxNarrowScalar(unsigned short *costs, int *hops, const unsigned short *theirs, int link, int neighbor,
+	int n, unsigned long long *changed)
+{
+	relaxNarrowTail(costs, hops, theirs, link, neighbor, 0, n, changed);
+}
+
+/* relaxNarrowSSE4()
+ *
+ * relaxNarrowTail() eight destinations at a time, with the saturating add
+ * the instruction set has for 16-bit lanes. The lanes' masks are widened to
+ * blend the 32-bit next hops.
+ */
+__attribute__((target("sse4.1")))
+void relaxNarrowSSE4(unsigned short *costs, int *hops, const unsigned short *theirs, int link, int neighbor,
+	int n, unsigned long long *changed)
+{
+	__m128i add = _mm_set1_epi16((short) link), via = _mm_set1_epi32(neighbor), ones = _mm_set1_epi32(-1);
+	int d;
+
+	for (d = 0; d + 8 <= n; d += 8) {
+		__m128i cost = _mm_adds_epu16(_mm_loadu_si128((const __m128i *) (theirs + d)), add);
+		__m128i curr = _mm_loadu_si128((const __m128i *) (costs + d));
+		__m128i low = _mm_min_epu16(cost, curr);
+		__m128i better = _mm_andnot_si128(_mm_cmpeq_epi16(low, curr), ones);
+		int bits = _mm_movemask_epi8(_mm_packs_epi16(better, _mm_setzero_si128()));
+
+		if (bits == 0)
+			continue;
+		_mm_storeu_si128((__m128i *) (costs + d), low);
+		_mm_storeu_si128((__m128i *) (hops + d),
+			_mm_blendv_epi8(_mm_loadu_si128((const __m128i *) (hops + d)), via, _mm_cvtepi16_epi32(better)));
+		_mm_storeu_si128((__m128i *) (hops + d + 4),
+			_mm_blendv_epi8(_mm_loadu_si128((const __m128i *) (hops + d + 4)), via,
+				_mm_cvtepi16_epi32(_mm_srli_si128(better, 8))));
+		changed[d / 64] |= (unsigned long long) bits << (d % 64);
+	}
+	relaxNarrowTail(costs, hops, theirs, link, neighbor, d, n, changed);
+}
+
+/* relaxNarrowAVX2()
+ *
+ * relaxNarrowTail() sixteen destinations at a time.
+ */
+__attribute__((target("avx2")))
+void relaxNarrowAVX2(unsigned short *costs, int *hops, const unsigned short *theirs, int link, int neighbor,
+	int n, unsigned long long *changed)
+{
+	__m256i add = _mm256_set1_epi16((short) link), via = _mm256_set1_epi32(neighbor), ones = _mm256_set1_epi32(-1);
+	int d;
+
+	for (d = 0; d + 16 <= n; d += 16) {
+		__m256i cost = _mm256_adds_epu16(_mm256_loadu_si256((const __m256i *) (theirs + d)), add);
+		__m256i curr = _mm256_loadu_si256((const __m256i *) (costs + d));
+		__m256i low = _mm256_min_epu16(cost, curr);
+		__m256i better = _mm256_andnot_si256(_mm256_cmpeq_epi16(low, curr), ones);
+		// packing works within 128-bit halves: bytes 0-7 and 16-23 hold the lanes
+		unsigned int packed = (unsigned int) _mm256_movemask_epi8(_mm256_packs_epi16(better, _mm256_setzero_si256()));
+		unsigned int bits = (packed & 0xff) | ((packed >> 8) & 0xff00);
+
+		if (bits == 0)
+			continue;
+		_mm256_storeu_si256((__m256i *) (costs + d), low);
+		_mm256_storeu_si256((__m256i *) (hops + d),
+			_mm256_blendv_epi8(_mm256_loadu_si256((const __m256i *) (hops + d)), via,
+				_mm256_cvtepi16_epi32(_mm256_castsi256_si128(better))));
+		_mm256_storeu_si256((__m256i *) (hops + d + 8),
+			_mm256_blendv_epi8(_mm256_loadu_si256((const __m256i *) (hops + d + 8)), via,
+				_mm256_cvtepi16_epi32(_mm256_extracti128_si256(better, 1))));
+		changed[d / 64] |= (unsigned long long) bits << (d % 64);
+	}
+	relaxNarrowTail(costs, hops, theirs, link, neighbor, d, n, changed);
+}
+
+/* relaxNarrowAVX512()
+ *
+ * relaxNarrowTail() thirty-two destinations at a time, storing through the
+ * mask of those that improved.
+ */
+__attribute__((target("avx512f,avx512bw")))
+void relaxNarrowAVX512(unsigned short *costs, int *hops, const unsigned short *theirs, int link, int neighbor,
+	int n, unsigned long long *changed)
+{
+	__m512i add = _mm512_set1_epi16((short) link), via = _mm512_set1_epi32(neighbor);
+	int d;
+
+	for (d = 0; d + 32 <= n; d += 32) {
+		__m512i cost = _mm512_adds_epu16(_mm512_loadu_si512(theirs + d), add);
+		__mmask32 better = _mm512_cmplt_epu16_mask(cost, _mm512_loadu_si512(costs + d));
+
+		if (better == 0)
+			continue;
+		_mm512_mask_storeu_epi16(costs + d, better, cost);
+		_mm512_mask_storeu_epi32(hops + d, (__mmask16) better, via);
+		_mm512_mask_storeu_epi32(hops + d + 16, (__mmask16) (better >> 16), via);
+		changed[d / 64] |= (unsigned long long) better << (d % 64);
+	}
+	relaxNarrowTail(costs, hops, theirs, link, neighbor, d, n, changed);
+}
+
+/* pickRelax()
+ *
+ * Sets the rounds up with the widest relaxation kernel this CPU runs for
+ * their cost width.
+ */
+void pickRelax(struct rounds *rs)
+{
+	__builtin_cpu_init();
+	if (rs->narrow) {
+		if (__builtin_cpu_supports("avx512bw")) {
+			rs->relaxNarrow = relaxNarrowAVX512;
+			rs->kernel = "AVX-512";
+		} else if (__builtin_cpu_supports("avx2")) {
+			rs->relaxNarrow = relaxNarrowAVX2;
+			rs->kernel = "AVX2";
+		} else if (__builtin_cpu_supports("sse4.1")) {
+			rs->relaxNarrow = relaxNarrowSSE4;
+			rs->kernel = "SSE4.1";
+		} else {
+			rs->relaxNarrow = relaxNarrowScalar;
+			rs->kernel = "scalar";
+		}
+	} else if (__builtin_cpu_supports("avx512f")) {
+		rs->relax = relaxAVX512;
+		rs->kernel = "AVX-512";
+	} else if (__builtin_cpu_supports("avx2")) {
+		rs->relax = relaxAVX2;
+		rs->kernel = "AVX2";
+	} else if (__builtin_cpu_supports("sse4.1")) {
+		rs->relax = relaxSSE4;
+		rs->kernel = "SSE4.1";
+	} else {
+		rs->relax = relaxScalar;
+		rs->kernel = "scalar";
+	}
+}
+
+/* openRounds()
+ *
+ * Sets up synchronous rounds on count threads, each taking a contiguous
+ * block of routers.
+ */
+void openRounds(struct network *net, int count)
+{
+	int n = net->numRouters, k;
+	size_t cells = (size_t) n * n;
+	bool narrow = net->infinity <= USHRT_MAX;
+	struct rounds *rs;
+
+	count = max(min(count, n), 1);
+	if ((rs = calloc(1, sizeof(struct rounds))) == NULL
+			|| (rs->costs[0] = aligned_alloc(ARENAALIGN, arenaBytes(cells, narrow ? sizeof(unsigned short) : sizeof(int)))) == NULL
+			|| (rs->costs[1] = aligned_alloc(ARENAALIGN, arenaBytes(cells, narrow ? sizeof(unsigned short) : sizeof(int)))) == NULL
+			|| (rs->nextHop = aligned_alloc(ARENAALIGN, arenaBytes(cells, sizeof(int)))) == NULL
+			|| (rs->dirty[0] = calloc((size_t) n * ((n + 63) / 64), sizeof(unsigned long long))) == NULL
+			|| (rs->dirty[1] = calloc((size_t) n * ((n + 63) / 64), sizeof(unsigned long long))) == NULL
+			|| (rs->workers = calloc(count, sizeof(struct roundWorker))) == NULL
+			|| (rs->changes = calloc(2 * count, sizeof(long long))) == NULL)
+		error("Error allocating rounds");
+	rs->numWorkers = count;
+	rs->narrow = narrow;
+	rs->costSize = narrow ? sizeof(unsigned short) : sizeof(int);
+	rs->words = (n + 63) / 64;
+	pickRelax(rs);
+	for (k = 0; k < count; k++) {
+		rs->workers[k].net = net;
+		rs->workers[k].id = k;
+		rs->workers[k].first = (int) ((long long) n * k / count);
+		rs->workers[k].last = (int) ((long long) n * (k + 1) / count);
+	}
+	net->rounds = rs;
+}
+
+/* closeRounds()
+ *
+ * Releases what openRounds() set up.
+ */
+void closeRounds(struct network *net)
+{
+	struct rounds *rs = net->rounds;
+
+	free(rs->costs[0]);
+	free(rs->costs[1]);
+	free(rs->nextHop);
+	free(rs->dirty[0]);
+	free(rs->dirty[1]);
+	free(rs->workers);
+	free(rs->changes);
+	free(rs->perRound);
+	free(rs);
+	net->rounds = NULL;
+}
+
+/* roundCost()
+ *
+ * Returns cost k of a round's costs, INT_MAX if unreachable.
+ */
+int roundCost(struct rounds *rs, const void *costs, size_t k)
+{
+	if (rs->narrow) {
+		unsigned short cost = ((const unsigned short *) costs)[k];
+		return cost == USHRT_MAX ? INT_MAX : cost;
+	}
+	return ((const int *) costs)[k];
+}
+
+/* setRoundCost()
+ *
+ * Sets cost k of a round's costs, INT_MAX for unreachable.
+ */
+void setRoundCost(struct rounds *rs, void *costs, size_t k, int cost)
+{
+	if (rs->narrow)
+		((unsigned short *) costs)[k] = cost == INT_MAX ? USHRT_MAX : (unsigned short) cost;
+	else
+		((int *) costs)[k] = cost;
+}
+
+/* relaxRound()
+ *
+ * Round r for worker w's routers: each relaxes the vector it had in round
+ * r - 1 against each live link plus what that neighbor had in round r - 1.
+ * Starting over from its own vector gives the same costs as starting from
+ * nothing, since costs only ever fall from round to round, and tells
+ * straight away which of them fell. For the same reason only the blocks a
+ * neighbor changed in round r - 1 can lower anything, so the rest are
+ * skipped. Costs at or above the infinity metric are unreachable. Returns
+ * how many costs changed since round r - 1.
+ */
+long long relaxRound(struct roundWorker *w, int r)
+{
+	struct network *net = w->net;
+	struct rounds *rs = net->rounds;
+	const char *prev = rs->costs[(r - 1) & 1];
+	char *curr = rs->costs[r & 1];
+	const unsigned long long *wasDirty = rs->dirty[(r - 1) & 1];
+	int n = net->numRouters, words = rs->words;
+	long long changes = 0;
+	int i, e, k;
+
+	for (i = w->first; i < w->last; i++) {
+		size_t at = (size_t) i * n;
+		int *hops = rs->nextHop + at;
+		unsigned long long *mine = rs->dirty[r & 1] + (size_t) i * words;
+
+		memcpy(curr + at * rs->costSize, prev + at * rs->costSize, n * rs->costSize);
+		memset(mine, 0, words * sizeof(unsigned long long));
+		for (e = net->adj.offsets[i]; e < net->adj.offsets[i + 1]; e++) {
+			int link = net->adj.costs[e], neighbor = net->adj.neighbors[e];
+			const unsigned long long *theirDirty = wasDirty + (size_t) neighbor * words;
+			size_t from = (size_t) neighbor * n;
+
+			if (link == INT_MAX)
+				continue;
+			for (k = 0; k < words; k++) {
+				int base = k * 64, len = min(64, n - base);
+				if (theirDirty[k] == 0)
+					continue;
+				if (rs->narrow)
+					rs->relaxNarrow((unsigned short *) curr + at + base, hops + base,
+						(const unsigned short *) prev + from + base, min(link, USHRT_MAX),
+						neighbor, len, mine + k);
+				else
+					rs->relax((int *) curr + at + base, hops + base, (const int *) prev + from + base,
+						link, neighbor, len, mine + k);
+			}
+		}
+		// only what fell can have fallen below infinity
+		for (k = 0; k < words; k++) {
+			unsigned long long bits = mine[k];
+			for (; bits != 0; bits &= bits - 1) {
+				int d = k * 64 + __builtin_ctzll(bits);
+				if (roundCost(rs, curr, at + d) >= net->infinity) {
+					setRoundCost(rs, curr, at + d, INT_MAX);
+					hops[d] = -1;
+					mine[k] &= ~(1ULL << (d % 64));
+					continue;
+				}
+				changes++;
+			}
+		}
+	}
+	return changes;
+}
+
+/* installRound()
+ *
+ * Copies the routes of the final round into worker w's routers' tables,
+ * logging each table that changed.
+ */
+void installRound(struct roundWorker *w, const void *costs)
+{
+	struct network *net = w->net;
+	struct rounds *rs = net->rounds;
+	int n = net->numRouters;
+	int i, d;
+
+	for (i = w->first; i < w->last; i++) {
+		struct router *table = &net->routers[i];
+		const int *hops = rs->nextHop + (size_t) i * n;
+		bool isChanged = false;
+
+		if (net->killed[i])
+			continue;
+		for (d = 0; d < n; d++) {
+			int cost = roundCost(rs, costs, (size_t) i * n + d);
+			if (d == i || (cost == table->costs[d] && hops[d] == table->nextHop[d]))
+				continue;
+			if (!isChanged)
+				table->version++;
+			setRoute(net, table, d, cost, hops[d]);
+			isChanged = true;
+		}
+		if (isChanged)
+			outputTable(net, table, false);
+	}
+}
+
+/* runRoundWorker()
+ *
+ * A worker's rounds: starting from vectors that only know their own router,
+ * it relaxes its block, waits for the others and tallies what changed
+ * across the network, until a round changes nothing. Worker 0 keeps the
+ * count of each round. Each worker then installs its block's tables.
+ */
+void *runRoundWorker(void *arg)
+{
+	struct roundWorker *w = arg;
+	struct network *net = w->net;
+	struct rounds *rs = net->rounds;
+	int n = net->numRouters;
+	long long total;
+	int i, k, r;
+
+	for (i = w->first; i < w->last; i++) {
+		int *hops = rs->nextHop + (size_t) i * n;
+		unsigned long long *dirty = rs->dirty[0] + (size_t) i * rs->words;
+		for (k = 0; k < n; k++) {
+			setRoundCost(rs, rs->costs[0], (size_t) i * n + k, k == i ? 0 : INT_MAX);
+			hops[k] = k == i ? i : -1;
+		}
+		memset(dirty, 0, rs->words * sizeof(unsigned long long));
+		dirty[i / 64] = 1ULL << (i % 64);
+	}
+	pthread_barrier_wait(&rs->barrier);
+
+	for (r = 1; ; r++) {
+		// a worker still tallying round r - 1 reads the other parity
+		rs->changes[2 * w->id + (r & 1)] = relaxRound(w, r);
+		pthread_barrier_wait(&rs->barrier);
+		for (total = 0, k = 0; k < rs->numWorkers; k++)
+			total += rs->changes[2 * k + (r & 1)];
+		if (w->id == 0) {
+			if (rs->count == rs->capacity) {
+				rs->capacity = max(2 * rs->capacity, 16);
+				if ((rs->perRound = realloc(rs->perRound, rs->capacity * sizeof(long long))) == NULL)
+					error("Error allocating rounds");
+			}
+			rs->perRound[rs->count++] = total;
+		}
+		if (total == 0)
+			break;
+	}
+	installRound(w, rs->costs[r & 1]);
+	return NULL;
+}
+
+/* runRounds()
+ *
+ * Computes every table afresh in synchronous rounds, taking the pending
+ * kill down first, on the calling thread and one more per extra worker.
+ * Returns when the tables were installed.
+ */
+long long runRounds(struct network *net)
+{
+	struct rounds *rs = net->rounds;
+	int k;
+
+	if (net->killing >= 0) {
+		killRouter(net, net->killing);
+		net->killing = -1;
+	}
+	rs->count = 0;
+	if ((errno = pthread_barrier_init(&rs->barrier, NULL, rs->numWorkers)) != 0)
+		error("Error creating barrier");
+	for (k = 1; k < rs->numWorkers; k++) {
+		if ((errno = pthread_create(&rs->workers[k].thread, NULL, runRoundWorker, &rs->workers[k])) != 0)
+			error("Error starting worker");
+	}
+	runRoundWorker(&rs->workers[0]);
+	for (k = 1; k < rs->numWorkers; k++)
+		pthread_join(rs->workers[k].thread, NULL);
+	pthread_barrier_destroy(&rs->barrier);
+	return nowUsec();
+}
+
+/* printRounds()
+ *
+ * Prints how many costs each round changed.
+ */
+void printRounds(struct network *net)
+{
+	struct rounds *rs = net->rounds;
+	int r;
+
+	printf("%d rounds on %d threads with the %s kernel on %d-bit costs, costs changed per round:",
+		rs->count, rs->numWorkers, rs->kernel, (int) rs->costSize * 8);
+	for (r = 0; r < rs->count; r++)
+		printf(" %lld", rs->perRound[r]);
+	printf("\n");
+}
+
+/* allocateWorkers()
+ *
+ * Splits the routers into count contiguous blocks of home routers, each
+ * watched by a worker with its own arena for its queue, batches, drain and
+ * timers, an epoll instance holding just its home routers' sockets and an
+ * eventfd to wake it. Any worker may end up running any router, so each
+ * timer heap has room for every timer. With pin, worker k is bound to the
+ * k-th CPU the process may run on, wrapping around.
+ */
+void allocateWorkers(struct network *net, int count, bool pin)
+{
+	struct epoll_event ev;
+	cpu_set_t allowed;
+	int n = net->numRouters, m = net->adj.offsets[n];
+	long long slots = 1;
+	int i, k;
+
+	if (pin && sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+		error("Error reading CPU affinity");
+	if ((net->workers = aligned_alloc(ARENAALIGN, count * sizeof(struct worker))) == NULL
+			|| (net->taskState = calloc(n, sizeof(int))) == NULL)
+		error("Error allocating workers");
+	memset(net->workers, 0, count * sizeof(struct worker));
+	net->numWorkers = count;
+	while (slots < n)
+		slots *= 2;
+
+	for (k = 0; k < count; k++) {
+		struct worker *w = &net->workers[k];
+		struct network *wn = &w->net;
+		int first = (int) ((long long) n * k / count), last = (int) ((long long) n * (k + 1) / count);
+		size_t row = arenaBytes(n, sizeof(int));
+
+		// the tables, links, sockets and settings are shared
+		*wn = *net;
+		wn->firstRouter = first;
+		wn->lastRouter = last;
+		wn->workers = NULL;
+		wn->numWorkers = 0;
+		wn->ringed = false;
+		memset(&wn->uring, 0, sizeof(wn->uring));
+		memset(&wn->drain, 0, sizeof(wn->drain));
+		memset(&wn->stats, 0, sizeof(wn->stats));
+
+		arenaInit(&wn->arena, 4 * row
+			+ arenaBytes(n, sizeof(bool))
+			+ arenaBytes(slots, sizeof(int))
+			+ arenaBytes(n + m, sizeof(struct timer))
+			+ arenaBytes(DVMAXDATAGRAM, 1)
+			+ 2 * (arenaBytes(IOBATCH, DVMAXDATAGRAM) + arenaBytes(IOBATCH, sizeof(struct mmsghdr))
+				+ arenaBytes(IOBATCH, sizeof(struct iovec))));
+		wn->rcvd.dests = arenaAlloc(&wn->arena, n * sizeof(int));
+		wn->rcvd.costs = arenaAlloc(&wn->arena, n * sizeof(int));
+		wn->drain.slot = arenaAlloc(&wn->arena, n * sizeof(int));
+		memset(wn->drain.slot, -1, n * sizeof(int));
+		wn->backlog = NULL;
+		wn->numBacklogged = 0;
+		wn->wokenRouters = arenaAlloc(&wn->arena, n * sizeof(int));
+		wn->isWoken = arenaAlloc(&wn->arena, n * sizeof(bool));
+		memset(wn->isWoken, 0, n * sizeof(bool));
+		wn->numWoken = 0;
+		wn->timers.heap = arenaAlloc(&wn->arena, (n + m) * sizeof(struct timer));
+		w->tasks.tasks = arenaAlloc(&wn->arena, slots * sizeof(int));
+		w->tasks.mask = slots - 1;
+		wn->tasks = &w->tasks;
+		wn->buf = arenaAlloc(&wn->arena, DVMAXDATAGRAM);
+		allocateBatch(&wn->arena, &wn->in);
+		allocateBatch(&wn->arena, &wn->out);
+
+		if ((wn->epollfd = epoll_create1(0)) < 0)
+			error("Error creating epoll instance");
+		for (i = first; i < last; i++) {
+			ev.events = EPOLLIN | EPOLLET;
+			ev.data.ptr = &net->routers[i];
+			if (epoll_ctl(wn->epollfd, EPOLL_CTL_ADD, net->sockfd[i], &ev) < 0)
+				error("Error registering socket");
+		}
+		if ((wn->wakefd = eventfd(0, EFD_NONBLOCK)) < 0)
+			error("Error creating eventfd");
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.ptr = NULL;
+		if (epoll_ctl(wn->epollfd, EPOLL_CTL_ADD, wn->wakefd, &ev) < 0)
+			error("Error registering eventfd");
+
+		w->shared = net;
+		w->id = k;
+		w->seed = (unsigned int) k * 2654435761u;
+		w->cpu = -1;
+		if (pin) {
+			int nth = k % CPU_COUNT(&allowed), cpu;
+			for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+				if (CPU_ISSET(cpu, &allowed) && nth-- == 0)
+					break;
+			}
+			w->cpu = cpu;
+		}
+	}
+}
+
+/* freeWorkers()
+ *
+ * Closes and releases what allocateWorkers() set up.
+ */
+void freeWorkers(struct network *net)
+{
+	int k;
+
+	for (k = 0; k < net->numWorkers; k++) {
+		struct network *wn = &net->workers[k].net;
+		close(wn->epollfd);
+		close(wn->wakefd);
+		free(wn->drain.vectors);
+		free(wn->drain.dests);
+		free(wn->drain.costs);
+		arenaFree(&wn->arena);
+	}
+	free(net->workers);
+	free(net->taskState);
+}
+
+/* wakeWorkers()
+ *
+ * Cuts every worker's wait short.
+ */
+void wakeWorkers(struct network *net)
+{
+	uint64_t one = 1;
+	int k;
+
+	for (k = 0; k < net->numWorkers; k++) {
+		if (write(net->workers[k].net.wakefd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+			error("Error waking worker");
+	}
+}
+
+/* gatherTasks()
+ *
+ * Queues every home router whose socket became readable and every router
+ * woken through its mailboxes since, and wakes a sleeping worker to steal
+ * if more than one task is waiting here.
+ */
+void gatherTasks(struct worker *w)
+{
+	struct network *net = &w->net, *shared = w->shared;
+	struct epoll_event events[EPOLLEVENTS];
+	uint64_t wakes;
+	int ready, k;
+
+	if ((ready = epoll_wait(net->epollfd, events, EPOLLEVENTS, 0)) < 0) {
+		if (errno != EINTR)
+			error("Error waiting for sockets");
+		return;
+	}
+	for (k = 0; k < ready; k++) {
+		// the coordinator or another worker cutting a wait short
+		if (events[k].data.ptr == NULL) {
+			while (read(net->wakefd, &wakes, sizeof(wakes)) > 0)
+				;
+			continue;
+		}
+		notifyRouter(net, ((struct router *) events[k].data.ptr)->index);
+	}
+	for (k = 0; k < net->numWoken; k++) {
+		net->isWoken[net->wokenRouters[k]] = false;
+		notifyRouter(net, net->wokenRouters[k]);
+	}
+	net->numWoken = 0;
+	if (__atomic_load_n(&w->tasks.tail, __ATOMIC_RELAXED) - __atomic_load_n(&w->tasks.head, __ATOMIC_RELAXED) <= 1)
+		return;
+	for (k = 0; k < shared->numWorkers; k++) {
+		if (__atomic_load_n(&shared->workers[k].sleeping, __ATOMIC_SEQ_CST)) {
+			wakes = 1;
+			if (write(shared->workers[k].net.wakefd, &wakes, sizeof(wakes)) < 0 && errno != EAGAIN)
+				error("Error waking worker");
+			break;
+		}
+	}
+}
+
+/* findTask()
+ *
+ * Returns the next router for worker w to run: the first one it queued, or
+ * failing that one stolen from another worker, starting from a random one.
+ * Oldest first, like the backlog without workers, lets DVs for a router
+ * pile up while it waits, rather than running the router just woken on its
+ * single DV and descending the graph depth first. Returns -1 if every queue
+ * looks empty.
+ */
+int findTask(struct worker *w)
+{
+	struct network *shared = w->shared;
+	int first, k, r;
+
+	while (__atomic_load_n(&w->tasks.tail, __ATOMIC_ACQUIRE) > __atomic_load_n(&w->tasks.head, __ATOMIC_ACQUIRE)) {
+		if ((r = takeTask(&w->tasks)) >= 0)
+			return r;
+	}
+	first = rand_r(&w->seed) % shared->numWorkers;
+	for (k = 0; k < shared->numWorkers; k++) {
+		struct worker *victim = &shared->workers[(first + k) % shared->numWorkers];
+		if (victim != w && (r = takeTask(&victim->tasks)) >= 0) {
+			w->net.stats.tasksStolen++;
+			return r;
+		}
+	}
+	return -1;
+}
+
+/* tasksWaiting()
+ *
+ * Returns true if any worker has routers queued.
+ */
+bool tasksWaiting(struct network *net)
+{
+	int k;
+
+	for (k = 0; k < net->numWorkers; k++) {
+		struct taskQueue *q = &net->workers[k].tasks;
+		if (__atomic_load_n(&q->tail, __ATOMIC_SEQ_CST) > __atomic_load_n(&q->head, __ATOMIC_SEQ_CST))
+			return true;
+	}
+	return false;
+}
+
+/* runTask()
+ *
+ * Runs router i, just taken from a queue: drains its socket, relaxes its
+ * table against the DVs and advertises the changes, then hands it back.
+ * Returns true if its table changed.
+ */
+bool runTask(struct network *net, int i)
+{
+	bool isChanged;
+
+	__atomic_exchange_n(&net->taskState[i], ROUTERRUNNING, __ATOMIC_ACQ_REL);
+	isChanged = handleDatagram(net, i);
+	net->stats.tasksRun++;
+	// a capped drain left DVs behind, and the socket will not say so again
+	releaseRouter(net, i, net->drain.more);
+	return isChanged;
+}
+
+/* runWorker()
+ *
+ * A worker thread: takes its share of a pending kill and waits for the
+ * others to do the same. Then, until told to stop, it queues its readable
+ * home routers, fires its timers, refreshes its home routers whenever the
+ * coordinator asks, and runs tasks, its own or stolen. With nothing to run
+ * anywhere it sleeps until a socket, a timer or a wake, publishing that it
+ * is idle.
+ */
+void *runWorker(void *arg)
+{
+	struct worker *w = arg;
+	struct network *net = &w->net, *shared = w->shared;
+
+	if (w->cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(w->cpu, &set);
+		if ((errno = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) != 0)
+			error("Error pinning worker");
+	}
+	if (shared->killing >= 0)
+		killRouter(net, shared->killing);
+	pthread_barrier_wait(&shared->barrier);
+
+	net->timers.lastActivity = nowUsec();
+	while (!__atomic_load_n(&shared->stopping, __ATOMIC_ACQUIRE)) {
+		long long now = nowUsec(), wake;
+		struct pollfd waiting = { net->epollfd, POLLIN, 0 };
+		unsigned int refresh;
+		int changed = 0, ran, i, r;
+
+		gatherTasks(w);
+		runTimers(net, now);
+		refresh = __atomic_load_n(&shared->refresh, __ATOMIC_ACQUIRE);
+		if (refresh != w->refreshed) {
+			for (i = net->firstRouter; i < net->lastRouter; i++) {
+				// wait out whoever runs it, running our own tasks meanwhile since it may be one of them
+				while (!acquireRouter(net, i)) {
+					if ((r = findTask(w)) >= 0)
+						changed += runTask(net, r);
+					else
+						sched_yield();
 				}
+				refreshRouter(net, i);
+				releaseRouter(net, i, false);
 			}
+			net->timers.lastActivity = now;
+		}
+		for (ran = 0; ran < TASKBATCH && (r = findTask(w)) >= 0; ran++)
+			changed += runTask(net, r);
+
+		now = nowUsec();
+		if (changed > 0) {
+			__atomic_add_fetch(&w->changes, changed, __ATOMIC_RELAXED);
+			__atomic_store_n(&w->convergedAt, now, __ATOMIC_RELAXED);
+		}
+		__atomic_store_n(&w->lastActivity, net->timers.lastActivity, __ATOMIC_RELAXED);
+		__atomic_store_n(&w->refreshed, refresh, __ATOMIC_SEQ_CST);
+		// routers it woke are queued at the top of the loop
+		if (ran > 0 || net->numWoken > 0)
+			continue;
 
-			if (FD_ISSET(sockfd[2], &socks)) {
-				if ( (n = recvfrom(sockfd[2], buf, BUFSIZE*sizeof(int), 0, (struct sockaddr *)&clientaddr, &clientlen)) < 0 )
-					error("Error receiving datagram from client\n");
+		/* wait on the epoll instance rather than in gatherTasks(), and only
+		 * once no queue holds anything to steal, so a worker is only ever
+		 * seen idle while it has nothing to handle */
+		wake = now + STABLETIMEOUT;
+		if (net->timers.count > 0 && net->timers.heap[0].due < wake)
+			wake = net->timers.heap[0].due;
+		__atomic_store_n(&w->sleeping, true, __ATOMIC_SEQ_CST);
+		if (!tasksWaiting(shared)) {
+			__atomic_store_n(&w->busy, net->timers.queued > 0, __ATOMIC_SEQ_CST);
+			if (poll(&waiting, 1, (int) ((max(wake - now, 0) + 999) / 1000)) < 0 && errno != EINTR)
+				error("Error waiting for sockets");
+		}
+		__atomic_store_n(&w->sleeping, false, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&w->busy, true, __ATOMIC_SEQ_CST);
+	}
+	return NULL;
+}
 
-				struct router compTable;
+/* runWorkers()
+ *
+ * Runs the network on the worker threads until it is stable, the same way
+ * runNetwork() does on one: once every worker has caught up with the last
+ * refresh, has nothing queued or backlogged and the whole network has been
+ * quiet for STABLETIMEOUT, either another refresh is called for or the
+ * workers are stopped. Returns when a table last changed, or started if none
+ * did.
+ */
+long long runWorkers(struct network *net, long long started)
+{
+	long long converged = started, refreshedAt = nowUsec();
+	bool refreshed = false;
+	int changes = 0, k;
 
-				bufferToTable(&buf, &compTable);
+	net->stopping = false;
+	if ((errno = pthread_barrier_init(&net->barrier, NULL, net->numWorkers)) != 0)
+		error("Error creating barrier");
+	for (k = 0; k < net->numWorkers; k++) {
+		struct worker *w = &net->workers[k];
+		w->refreshed = net->refresh;
+		w->lastActivity = refreshedAt;
+		w->busy = true;
+		w->changes = 0;
+		w->convergedAt = started;
+		if ((errno = pthread_create(&w->thread, NULL, runWorker, w)) != 0)
+			error("Error starting worker");
+	}
 
-				if(updateTable(&tableC, compTable) == false)
-					count++;
-				else
-					count = 0;
+	while (1) {
+		long long now, last = refreshedAt;
+		bool quiet = true;
 
-				tableToBuffer(&tableC, &buf);
+		usleep(WORKERPOLL);
+		now = nowUsec();
+		for (k = 0; k < net->numWorkers; k++) {
+			struct worker *w = &net->workers[k];
+			if (__atomic_load_n(&w->refreshed, __ATOMIC_SEQ_CST) != net->refresh
+					|| __atomic_load_n(&w->busy, __ATOMIC_SEQ_CST))
+				quiet = false;
+			last = max(last, __atomic_load_n(&w->lastActivity, __ATOMIC_RELAXED));
+		}
+		if (!quiet || now - last < STABLETIMEOUT)
+			continue;
 
-				for (i=0; i<NUMROUTERS; i++) {
-					if (neighborMatrix.r[2][i] != -1) {
-						n = sendto(sockfd[2], buf, BUFSIZE*sizeof(int), 0, (struct sockaddr *)&serveraddr[neighborMatrix.r[2][i]], clientlen);
-						if (n < 0)
-							error("Error sending to client");
-					}
-				}
+		for (k = 0; k < net->numWorkers; k++)
+			changes += __atomic_exchange_n(&net->workers[k].changes, 0, __ATOMIC_RELAXED);
+		if (changes == 0 && refreshed)
+			break;
+		__atomic_add_fetch(&net->refresh, 1, __ATOMIC_RELEASE);
+		wakeWorkers(net);
+		refreshed = true;
+		changes = 0;
+		refreshedAt = nowUsec();
+	}
+
+	__atomic_store_n(&net->stopping, true, __ATOMIC_RELEASE);
+	wakeWorkers(net);
+	for (k = 0; k < net->numWorkers; k++) {
+		struct worker *w = &net->workers[k];
+		pthread_join(w->thread, NULL);
+		converged = max(converged, w->convergedAt);
+		net->stats.datagramsSent += w->net.stats.datagramsSent;
+		net->stats.bytesSent += w->net.stats.bytesSent;
+		net->stats.datagramsReceived += w->net.stats.datagramsReceived;
+		net->stats.sendCalls += w->net.stats.sendCalls;
+		net->stats.receiveCalls += w->net.stats.receiveCalls;
+		net->stats.tasksRun += w->net.stats.tasksRun;
+		net->stats.tasksStolen += w->net.stats.tasksStolen;
+		memset(&w->net.stats, 0, sizeof(w->net.stats));
+	}
+	pthread_barrier_destroy(&net->barrier);
+	net->killing = -1;
+	return converged;
+}
+
+/* spawnProcesses()
+ *
+ * Starts one process per router, each running this program again with -R
+ * and the router's name and -C and its end of a control socket pair, ahead
+ * of the options the supervisor was given. The supervisor keeps the other
+ * end of each pair, registered with its epoll instance.
+ */
+void spawnProcesses(struct network *net, int argc, char *argv[])
+{
+	int n = net->numRouters;
+	char **args = malloc((argc + 5) * sizeof(char *));
+	struct epoll_event ev;
+	char fd[16];
+	int pair[2], i;
+
+	net->processes = calloc(n, sizeof(struct process));
+	if (args == NULL || net->processes == NULL)
+		error("Error allocating router processes");
+	net->numProcesses = n;
+	reserveDescriptors(n);
+	if ((net->epollfd = epoll_create1(0)) < 0)
+		error("Error creating epoll instance");
+
+	args[0] = argv[0];
+	args[1] = "-R";
+	args[3] = "-C";
+	args[4] = fd;
+	memcpy(args + 5, argv + 1, argc * sizeof(char *));
+	fflush(stdout);
+	for (i = 0; i < n; i++) {
+		struct process *p = &net->processes[i];
+
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) < 0)
+			error("Error creating control socket");
+		if ((p->pid = fork()) < 0)
+			error("Error starting router process");
+		if (p->pid == 0) {
+			// dup() leaves close-on-exec off for the child's end only
+			snprintf(fd, sizeof(fd), "%d", dup(pair[1]));
+			args[2] = (char *) routerName(net, i);
+			execv("/proc/self/exe", args);
+			perror("Error running router process");
+			_exit(127);
+		}
+		close(pair[1]);
+		p->ctlfd = pair[0];
+		p->alive = true;
+		ev.events = EPOLLIN;
+		ev.data.ptr = p;
+		if (epoll_ctl(net->epollfd, EPOLL_CTL_ADD, p->ctlfd, &ev) < 0)
+			error("Error registering control socket");
+	}
+	free(args);
+}
+
+/* sendCommand()
+ *
+ * Sends router i's process a command, if it is still running.
+ */
+void sendCommand(struct network *net, int i, int kind)
+{
+	struct command c = { kind, net->killing, net->kicking, net->refresh };
+	struct process *p = &net->processes[i];
+
+	// a process that died is noticed when its socket reads as closed
+	if (p->alive)
+		send(p->ctlfd, &c, sizeof(c), MSG_NOSIGNAL);
+}
+
+/* endProcess()
+ *
+ * Takes router i's process out of the network, killing it first unless it
+ * already exited.
+ */
+void endProcess(struct network *net, int i)
+{
+	struct process *p = &net->processes[i];
+
+	if (!p->alive)
+		return;
+	kill(p->pid, SIGKILL);
+	waitpid(p->pid, NULL, 0);
+	close(p->ctlfd);
+	p->alive = false;
+}
+
+/* takeReports()
+ *
+ * Takes in every report waiting from router i's process: status, drain
+ * acknowledgements, and its table in chunks once stopped, which is copied
+ * into the supervisor's as the process has it, ports included. A process
+ * whose control socket closed has died.
+ */
+void takeReports(struct network *net, int i)
+{
+	struct process *p = &net->processes[i];
+	struct router *table = &net->routers[i];
+	struct reportedRoute routes[REPORTCHUNK];
+	struct report r;
+	struct iovec iov[2];
+	struct msghdr msg;
+	ssize_t got;
+	int d;
+
+	while (p->alive) {
+		iov[0].iov_base = &r;
+		iov[0].iov_len = sizeof(r);
+		iov[1].iov_base = routes;
+		iov[1].iov_len = sizeof(routes);
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = 2;
+
+		if ((got = recvmsg(p->ctlfd, &msg, MSG_DONTWAIT)) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+		if (got < (ssize_t) sizeof(r)) {
+			printf("Router %s's process exited\n", routerName(net, i));
+			endProcess(net, i);
+			return;
+		}
+		p->status = r;
+		p->changes += r.changes;
+		if (r.kind == REPORTDRAINED)
+			p->drained = true;
+		if (r.kind == REPORTSTOPPED)
+			p->stopped = true;
+		if (r.kind != REPORTROUTES)
+			continue;
+		for (d = 0; d < r.count; d++) {
+			setRoute(net, table, r.first + d, routes[d].cost, routes[d].fib.nextHop);
+			table->outgoingPorts[r.first + d] = routes[d].fib.port;
+			table->fib[r.first + d].port = routes[d].fib.port;
+		}
+	}
+}
+
+/* readReports()
+ *
+ * Waits up to timeout msecs, forever if negative, for the router processes
+ * to report, then takes in the reports of every process that has.
+ */
+void readReports(struct network *net, int timeout)
+{
+	struct epoll_event events[EPOLLEVENTS];
+	int ready, k;
+
+	do {
+		if ((ready = epoll_wait(net->epollfd, events, EPOLLEVENTS, timeout)) < 0) {
+			if (errno != EINTR)
+				error("Error waiting for router processes");
+			return;
+		}
+		for (k = 0; k < ready; k++)
+			takeReports(net, (struct process *) events[k].data.ptr - net->processes);
+		timeout = 0;
+	} while (ready == EPOLLEVENTS);
+}
+
+/* drainProcesses()
+ *
+ * Has every router process discard the DVs queued on its socket and waits
+ * until they all have.
+ */
+void drainProcesses(struct network *net)
+{
+	int k;
+
+	for (k = 0; k < net->numProcesses; k++) {
+		net->processes[k].drained = false;
+		sendCommand(net, k, COMMANDDRAIN);
+	}
+	for (k = 0; k < net->numProcesses; k++) {
+		while (net->processes[k].alive && !net->processes[k].drained)
+			readReports(net, -1);
+		printf("Clearing Router %s's input buffers...[OK]\n", routerName(net, k));
+	}
+}
+
+/* runProcesses()
+ *
+ * Runs the network on the router processes until it is stable, the way
+ * runWorkers() does on threads but going by the processes' reports. A
+ * router being killed has its process killed, like a crash, and the others
+ * take it down. The processes report their tables when stopped. Returns when
+ * a table last changed, or started if none did.
+ */
+long long runProcesses(struct network *net, long long started)
+{
+	long long converged = started, refreshedAt = nowUsec();
+	bool refreshed = false;
+	int changes = 0, i, e, k;
+
+	if (net->killing >= 0) {
+		endProcess(net, net->killing);
+		net->killed[net->killing] = true;
+		resetTable(net, net->killing);
+		// the supervisor's links go down with it too, for the all-pairs check
+		for (i = 0; i < net->numRouters; i++) {
+			for (e = net->adj.offsets[i]; e < net->adj.offsets[i + 1]; e++) {
+				if (i == net->killing || net->adj.neighbors[e] == net->killing)
+					net->adj.costs[e] = INT_MAX;
 			}
-			if (FD_ISSET(sockfd[3], &socks)) {
-				if ( (n = recvfrom(sockfd[3], buf, BUFSIZE*sizeof(int), 0, (struct sockaddr *)&clientaddr, &clientlen)) < 0 )
-					error("Error receiving datagram from client\n");
+		}
+	}
+	for (k = 0; k < net->numProcesses; k++) {
+		struct process *p = &net->processes[k];
+		memset(&p->status, 0, sizeof(p->status));
+		p->status.busy = true;
+		p->status.refreshed = net->refresh;
+		p->status.lastActivity = refreshedAt;
+		p->changes = 0;
+		p->stopped = false;
+		sendCommand(net, k, COMMANDSTART);
+	}
+	net->kicking = -1;
 
-				struct router compTable;
+	while (1) {
+		long long now, last = refreshedAt;
+		bool quiet = true;
 
-				bufferToTable(&buf, &compTable);
+		usleep(WORKERPOLL);
+		readReports(net, 0);
+		now = nowUsec();
+		for (k = 0; k < net->numProcesses; k++) {
+			struct process *p = &net->processes[k];
+			if (!p->alive)
+				continue;
+			if (p->status.refreshed != net->refresh || p->status.busy)
+				quiet = false;
+			last = max(last, p->status.lastActivity);
+		}
+		if (!quiet || now - last < STABLETIMEOUT)
+			continue;
 
-				if(updateTable(&tableD, compTable) == false)
-					count++;
-				else
-					count = 0;
+		for (k = 0; k < net->numProcesses; k++) {
+			changes += net->processes[k].changes;
+			net->processes[k].changes = 0;
+		}
+		if (changes == 0 && refreshed)
+			break;
+		net->refresh++;
+		for (k = 0; k < net->numProcesses; k++)
+			sendCommand(net, k, COMMANDREFRESH);
+		refreshed = true;
+		changes = 0;
+		refreshedAt = nowUsec();
+	}
 
+	for (k = 0; k < net->numProcesses; k++)
+		sendCommand(net, k, COMMANDSTOP);
+	for (k = 0; k < net->numProcesses; k++) {
+		struct process *p = &net->processes[k];
+		while (p->alive && !p->stopped)
+			readReports(net, -1);
+		if (!p->alive)
+			continue;
+		converged = max(converged, p->status.convergedAt);
+		net->stats.datagramsSent += p->status.stats.datagramsSent;
+		net->stats.bytesSent += p->status.stats.bytesSent;
+		net->stats.datagramsReceived += p->status.stats.datagramsReceived;
+		net->stats.sendCalls += p->status.stats.sendCalls;
+		net->stats.receiveCalls += p->status.stats.receiveCalls;
+	}
+	net->killing = -1;
+	return converged;
+}
 
-				tableToBuffer(&tableD, &buf);
-				
-				for (i=0; i<NUMROUTERS; i++) {
-					if (neighborMatrix.r[3][i] != -1) {
-						n = sendto(sockfd[3], buf, BUFSIZE*sizeof(int), 0, (struct sockaddr *)&serveraddr[neighborMatrix.r[3][i]], clientlen);
-						if (n < 0)
-							error("Error sending to client");
-					}
-				}
+/* printProcesses()
+ *
+ * Prints the CPU time and peak memory the running router processes have
+ * used so far, as they last reported.
+ */
+void printProcesses(struct network *net)
+{
+	long long cpu = 0;
+	long rss = 0;
+	int count = 0, busiest = -1, largest = -1, k;
+
+	for (k = 0; k < net->numProcesses; k++) {
+		struct report *r = &net->processes[k].status;
+		if (!net->processes[k].alive)
+			continue;
+		count++;
+		cpu += r->cpuUsec;
+		rss += r->maxRss;
+		if (busiest < 0 || r->cpuUsec > net->processes[busiest].status.cpuUsec)
+			busiest = k;
+		if (largest < 0 || r->maxRss > net->processes[largest].status.maxRss)
+			largest = k;
+	}
+	if (count == 0)
+		return;
+	printf("%d router processes: %.3f s CPU in all, at most %.3f s (Router %s); peak RSS %ld KB on average, at most %ld KB (Router %s)\n",
+		count, cpu / 1e6, net->processes[busiest].status.cpuUsec / 1e6, routerName(net, busiest),
+		rss / count, net->processes[largest].status.maxRss, routerName(net, largest));
+}
+
+/* endProcesses()
+ *
+ * Tells every router process to exit and waits for them all.
+ */
+void endProcesses(struct network *net)
+{
+	int k;
+
+	for (k = 0; k < net->numProcesses; k++) {
+		struct process *p = &net->processes[k];
+		if (!p->alive)
+			continue;
+		sendCommand(net, k, COMMANDEXIT);
+		waitpid(p->pid, NULL, 0);
+		close(p->ctlfd);
+		p->alive = false;
+	}
+	close(net->epollfd);
+	free(net->processes);
+}
+
+/* sendReport()
+ *
+ * Sends the supervisor a report from router process net. A REPORTSTOPPED
+ * one is preceded by the table, REPORTCHUNK routes per message.
+ */
+void sendReport(struct network *net, struct report *r)
+{
+	struct router *table = &net->routers[net->firstRouter];
+	struct reportedRoute routes[REPORTCHUNK];
+	struct report chunk = *r;
+	struct iovec iov[2];
+	struct msghdr msg;
+	int first = 0, d;
+
+	do {
+		if (r->kind == REPORTSTOPPED && first < net->numRouters) {
+			chunk.kind = REPORTROUTES;
+			chunk.first = first;
+			chunk.count = min(REPORTCHUNK, net->numRouters - first);
+			for (d = 0; d < chunk.count; d++) {
+				routes[d].cost = table->costs[first + d];
+				routes[d].fib = table->fib[first + d];
 			}
-			if (FD_ISSET(sockfd[4], &socks)) {
-				if ( (n = recvfrom(sockfd[4], buf, BUFSIZE*sizeof(int), 0, (struct sockaddr *)&clientaddr, &clientlen)) < 0 )
-					error("Error receiving datagram from client\n");
+		} else {
+			chunk = *r;
+		}
+		iov[0].iov_base = &chunk;
+		iov[0].iov_len = sizeof(chunk);
+		iov[1].iov_base = routes;
+		iov[1].iov_len = chunk.count * sizeof(struct reportedRoute);
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = chunk.kind == REPORTROUTES ? 2 : 1;
+		if (sendmsg(net->wakefd, &msg, MSG_NOSIGNAL) < 0) {
+			if (errno == EPIPE || errno == ECONNRESET)
+				exit(0);	// the supervisor is gone
+			error("Error reporting to the supervisor");
+		}
+		first += chunk.kind == REPORTROUTES ? chunk.count : 0;
+	} while (chunk.kind == REPORTROUTES);
+}
+
+/* reportStatus()
+ *
+ * Reports r to the supervisor unless it says nothing new since sent, the
+ * last report.
+ */
+void reportStatus(struct network *net, struct report *r, struct report *sent)
+{
+	if (memcmp(r, sent, sizeof(*r)) == 0)
+		return;
+	sendReport(net, r);
+	r->changes = 0;
+	*sent = *r;
+}
 
-				struct router compTable;
+/* peakResident()
+ *
+ * Returns this process's peak resident set in KB. Unlike getrusage()'s, it
+ * starts over at exec, so a router process is not charged the supervisor's.
+ */
+long peakResident()
+{
+	char line[128];
+	long kb = 0;
+	FILE *f;
 
-				bufferToTable(&buf, &compTable);
+	if ((f = fopen("/proc/self/status", "r")) == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "VmHWM: %ld", &kb) == 1)
+			break;
+	}
+	fclose(f);
+	return kb;
+}
 
+/* runPhase()
+ *
+ * Runs router process net's event loop from a COMMANDSTART until a
+ * COMMANDSTOP, taking the killed router down and advertising first if
+ * start says so, and refreshing on a COMMANDREFRESH. Before each wait the
+ * process reports where it stands, and again if it wakes to work; once
+ * stopped it reports its table.
+ */
+void runPhase(struct network *net, struct command *start)
+{
+	struct pollfd ready = { net->epollfd, POLLIN, 0 };
+	struct report r, sent;
+	struct rusage usage;
+	struct command c;
+	int i = net->firstRouter;
+	bool stopping = false;
 
-				if(updateTable(&tableE, compTable) == false)
-					count++;
-				else
-					count = 0;
+	memset(&net->stats, 0, sizeof(net->stats));
+	if (start->killing >= 0)
+		killRouter(net, start->killing);
+	if (start->kick == i)
+		net->transport->kick(net, i);
+	net->timers.lastActivity = nowUsec();
+	memset(&r, 0, sizeof(r));
+	r.kind = REPORTSTATUS;
+	r.busy = true;
+	r.refreshed = start->refresh;
+	r.lastActivity = net->timers.lastActivity;
+	sent = r;
 
+	while (!stopping) {
+		// the supervisor judges quiet, so only timers cut the wait short
+		long long now = nowUsec(), wait = -1;
+		if (net->timers.count > 0)
+			wait = (max(net->timers.heap[0].due - now, 0) + 999) / 1000;
 
-				tableToBuffer(&tableE, &buf);
+		if (net->numBacklogged == 0 && poll(&ready, 1, 0) == 0) {
+			r.busy = net->timers.queued > 0;
+			r.lastActivity = net->timers.lastActivity;
+			reportStatus(net, &r, &sent);
+			if (poll(&ready, 1, (int) wait) > 0) {
+				r.busy = true;
+				reportStatus(net, &r, &sent);
+			}
+		}
+		int changed = pollSockets(net, 0);
+		now = nowUsec();
+		if (changed > 0) {
+			r.changes += changed;
+			r.convergedAt = now;
+		}
+		runTimers(net, now);
 
-				for (i=0; i<NUMROUTERS; i++) {
-					if (neighborMatrix.r[4][i] != -1) {
-						n = sendto(sockfd[4], buf, BUFSIZE*sizeof(int), 0, (struct sockaddr *)&serveraddr[neighborMatrix.r[4][i]], clientlen);
-						if (n < 0)
-							error("Error sending to client");
-					}
-				}
+		if (!net->woken)
+			continue;
+		net->woken = false;
+		ssize_t got;
+		while ((got = recv(net->wakefd, &c, sizeof(c), MSG_DONTWAIT)) == sizeof(c)) {
+			if (c.kind == COMMANDREFRESH) {
+				refreshTables(net);
+				net->timers.lastActivity = nowUsec();
+				r.refreshed = c.refresh;
+			} else if (c.kind == COMMANDSTOP) {
+				stopping = true;
 			}
-			if (FD_ISSET(sockfd[5], &socks)) {
-				if ( (n = recvfrom(sockfd[5], buf, BUFSIZE*sizeof(int), 0, (struct sockaddr *)&clientaddr, &clientlen)) < 0 )
-					error("Error receiving datagram from client\n");
+		}
+		if (got == 0)
+			exit(0);	// the supervisor is gone
+	}
+
+	getrusage(RUSAGE_SELF, &usage);
+	// the supervisor logs the stable table after what this one has
+	flushLog(net, &net->routers[net->firstRouter]);
+	r.kind = REPORTSTOPPED;
+	r.busy = false;
+	r.lastActivity = net->timers.lastActivity;
+	r.stats = net->stats;
+	r.cpuUsec = (long long) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+		+ usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+	r.maxRss = peakResident();
+	sendReport(net, &r);
+}
+
+/* routerProcess()
+ *
+ * The loop of a process running the one router net->firstRouter for a
+ * supervisor: carries out its commands until told to exit or the supervisor
+ * goes away.
+ */
+void routerProcess(struct network *net)
+{
+	unsigned char *bufs[IOBATCH];
+	size_t lens[IOBATCH];
+	struct epoll_event ev;
+	struct report r;
+	struct command c;
+	int i = net->firstRouter;
+
+	// commands cut the event loop's wait short
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.ptr = NULL;
+	if (epoll_ctl(net->epollfd, EPOLL_CTL_ADD, net->wakefd, &ev) < 0)
+		error("Error registering control socket");
+	while (recv(net->wakefd, &c, sizeof(c), 0) == sizeof(c) && c.kind != COMMANDEXIT) {
+		if (c.kind == COMMANDSTART) {
+			runPhase(net, &c);
+		} else if (c.kind == COMMANDDRAIN) {
+			while (net->transport->receive(net, i, bufs, lens) > 0)
+				;
+			net->transport->release(net, i);
+			memset(&r, 0, sizeof(r));
+			r.kind = REPORTDRAINED;
+			sendReport(net, &r);
+		}
+	}
+}
+
+const struct transport udpTransport = {
+	udpBuffer, udpSend, udpFlush, udpReceive, udpRelease, udpKick
+};
+
+/* DVs go straight into the receiving router's mailboxes, without a copy or
+ * a system call. */
+const struct transport mailboxTransport = {
+	mailboxBuffer, mailboxSend, mailboxFlush, mailboxReceive, mailboxRelease, mailboxKick
+};
 
-				struct router compTable;
+/* DVs become events in the simulator, delivered in virtual time. */
+const struct transport simTransport = {
+	simBuffer, simSend, simFlush, simReceive, simRelease, simKick
+};
+
+/* readRouter()
+ *
+ * Reads a router name from the console and returns its id, or -1.
+ */
+int readRouter(struct network *net)
+{
+	char name[NAMESIZE];
+	int id, k;
+
+	if (scanf(" %63s", name) != 1)
+		return -1;
+	if ((id = findRouter(&net->topo, name)) >= 0)
+		return id;
+	for (k = 0; name[k]; k++)
+		name[k] = toupper(name[k]);
+	return findRouter(&net->topo, name);
+}
+
+/* defaultInfinity()
+ *
+ * Returns one more than the cost of the longest loop-free path the topology
+ * could have, so no real route is ever taken for unreachable while counting
+ * to infinity still stops.
+ */
+int defaultInfinity(struct topology *topo)
+{
+	int maxCost = 1;
+	int i;
 
-				bufferToTable(&buf, &compTable);
+	for (i=0; i<topo->numLinks; i++) {
+		if (topo->links[i].cost != INT_MAX)
+			maxCost = max(maxCost, topo->links[i].cost);
+	}
+	if (topo->numRouters > 1 && maxCost > (INT_MAX - 1) / (topo->numRouters - 1))
+		return INT_MAX;
+	return maxCost * (topo->numRouters - 1) + 1;
+}
+
+/* usage()
+ *
+ * Prints the command line options and exits.
+ */
+void usage(char *prog)
+{
+	fprintf(stderr, "usage: %s [-f topology] [-i infinity] [-s all|split|poison] [-p period] [-g gap] [-B] [-U] [-t threads] [-a] [-M] [-P] [-S seed] [-L delay] [-r] [-W] [-O] <starting router>\n"
+		"  -f topology   text or binary topology file (default sample.txt)\n"
+		"  -i infinity   smallest cost treated as unreachable (default: longest possible path + 1)\n"
+		"  -s mode       routes learned from a neighbor are advertised back to it as is,\n"
+		"                not at all (split horizon) or as unreachable (poison reverse, default)\n"
+		"  -p period     msecs between a router's periodic full updates, jittered (default %d)\n"
+		"  -g gap        least msecs between triggered updates to one neighbor (default %d)\n"
+		"  -B            one system call per datagram instead of recvmmsg/sendmmsg batches\n"
+		"  -U            io_uring multishot receives and linked sends instead of epoll,\n"
+		"                if the kernel supports them\n"
+		"  -t threads    run the routers on this many work-stealing worker threads, each with\n"
+		"                its own event loop (default: none)\n"
+		"  -a            pin each worker thread to its own CPU\n"
+		"  -M            pass DVs through in-process mailboxes instead of UDP sockets\n"
+		"  -P            run each router as its own process under this one, started as\n"
+		"                -R router -C control-descriptor\n"
+		"  -S seed       simulate the network in virtual time instead, deterministically\n"
+		"                under the seed\n"
+		"  -L delay      shortest simulated link delay in usecs; each link's is drawn\n"
+		"                from delay .. 2 x delay (default %d)\n"
+		"  -r            compute the tables in synchronous Bellman-Ford rounds instead,\n"
+		"                on the -t threads\n"
+		"  -W            start every router off with its shortest paths already installed\n"
+		"  -O            check every table against the shortest paths once stable\n",
+		prog, PERIODICUPDATE, TRIGGEREDGAP, SIMDELAY);
+	exit(1);
+}
 
+int main(int argc, char *argv[])
+{
+	long long started, converged, wall;
+	char *filepath = "sample.txt";
+	struct network net;
+	int infinity = 0, advertise = POISON_REVERSE;
+	long long period = PERIODICUPDATE, gap = TRIGGEREDGAP, delay = SIMDELAY;
+	bool batched = true, ringed = false, pin = false, inProcess = false, supervise = false, simulate = false,
+		synchronous = false, warm = false, oracle = false;
+	unsigned int seed = 0;
+	char *self = NULL;
+	int threads = 0, ctlfd = -1, first, last;
+	int i, opt;
 
-				if(updateTable(&tableF, compTable) == false)
-					count++;
+	while ((opt = getopt(argc, argv, "f:i:s:p:g:BUt:aMPS:L:rWOR:C:")) != -1) {
+		switch (opt)
+		{
+			case 'f':
+				filepath = optarg;
+				break;
+			case 'i':
+				if ((infinity = atoi(optarg)) <= 0)
+					usage(argv[0]);
+				break;
+			case 's':
+				if (strcmp(optarg, "all") == 0)
+					advertise = ADVERTISE_ALL;
+				else if (strcmp(optarg, "split") == 0)
+					advertise = SPLIT_HORIZON;
+				else if (strcmp(optarg, "poison") == 0)
+					advertise = POISON_REVERSE;
 				else
-					count = 0;
+					usage(argv[0]);
+				break;
+			case 'p':
+				if ((period = atoll(optarg)) <= 0)
+					usage(argv[0]);
+				break;
+			case 'g':
+				if ((gap = atoll(optarg)) < 0)
+					usage(argv[0]);
+				break;
+			case 'B':
+				batched = false;
+				break;
+			case 'U':
+				ringed = true;
+				break;
+			case 't':
+				if ((threads = atoi(optarg)) < 0)
+					usage(argv[0]);
+				break;
+			case 'a':
+				pin = true;
+				break;
+			case 'M':
+				inProcess = true;
+				break;
+			case 'P':
+				supervise = true;
+				break;
+			case 'S':
+				simulate = true;
+				seed = (unsigned int) strtoul(optarg, NULL, 0);
+				break;
+			case 'L':
+				if ((delay = atoll(optarg)) < 0)
+					usage(argv[0]);
+				break;
+			case 'r':
+				synchronous = true;
+				break;
+			case 'W':
+				warm = true;
+				break;
+			case 'O':
+				oracle = true;
+				break;
+			case 'R':
+				self = optarg;
+				break;
+			case 'C':
+				ctlfd = atoi(optarg);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind >= argc || (self != NULL && ctlfd < 0))
+		usage(argv[0]);
+
+	memset(&net, 0, sizeof(net));
+	loadTopology(filepath, &net.topo);
+	first = 0;
+	last = net.topo.numRouters;
+	if (self != NULL) {
+		/* a router process, started by a supervisor with the same options */
+		if ((first = findRouter(&net.topo, self)) < 0) {
+			fprintf(stderr, "Unknown router %s\n", self);
+			exit(1);
+		}
+		last = first + 1;
+		supervise = inProcess = ringed = simulate = synchronous = false;
+		threads = 0;
+	}
+	if (synchronous && (supervise || inProcess || ringed || simulate)) {
+		fprintf(stderr, "synchronous rounds run without sockets, ignoring -P, -M, -U and -S\n");
+		supervise = inProcess = ringed = simulate = false;
+	}
+	if (simulate && (supervise || inProcess || threads > 0 || ringed)) {
+		fprintf(stderr, "the simulator runs every router on one thread without sockets, ignoring -P, -M, -t and -U\n");
+		supervise = inProcess = ringed = false;
+		threads = 0;
+	}
+	if (supervise && (inProcess || threads > 0 || ringed)) {
+		fprintf(stderr, "router processes run one epoll loop each over UDP, ignoring -M, -t and -U\n");
+		inProcess = ringed = false;
+		threads = 0;
+	}
+	allocateNetwork(&net, first, last);
+	net.infinity = infinity > 0 ? infinity : defaultInfinity(&net.topo);
+	net.advertise = advertise;
+	net.batched = batched;
+	net.transport = simulate ? &simTransport : inProcess ? &mailboxTransport : &udpTransport;
+	if (synchronous)
+		net.transport = NULL;
+	if (!supervise && !simulate && !synchronous)
+		openSockets(&net);
+	if (ringed && inProcess) {
+		fprintf(stderr, "io_uring carries UDP only, using mailboxes\n");
+		ringed = false;
+	}
+	if (ringed && threads > 0) {
+		fprintf(stderr, "io_uring runs on one thread, using epoll\n");
+		ringed = false;
+	}
+	if (ringed && !uringSetup(&net)) {
+		fprintf(stderr, "io_uring unavailable, using epoll\n");
+		ringed = false;
+	}
+	net.ringed = ringed;
 
+	int start = findRouter(&net.topo, argv[optind]);
+	if (start < 0) {
+		fprintf(stderr, "Unknown starting router %s\n", argv[optind]);
+		exit(1);
+	}
 
-				tableToBuffer(&tableF, &buf);
+	reinitializeTables(&net);
+	initializeFromFile(&net);
+	if (warm)
+		installSolution(&net, threads);
+	if (self != NULL) {
+		startTimers(&net, period * 1000, gap * 1000);
+		net.wakefd = ctlfd;
+		routerProcess(&net);
+		close(net.sockfd[first]);
+		close(net.epollfd);
+		return 0;
+	}
+	if (simulate)
+		openSimulation(&net, seed, delay);
+	initializeOutputFiles(&net);
+	if (supervise)
+		spawnProcesses(&net, argc, argv);
+	if (inProcess)
+		openMailboxes(&net);
+	if (synchronous) {
+		openRounds(&net, threads);
+	} else if (threads > 0) {
+		allocateWorkers(&net, min(threads, net.numRouters), pin);
+		for (i=0; i<net.numWorkers; i++)
+			startTimers(&net.workers[i].net, period * 1000, gap * 1000);
+	} else if (!supervise) {
+		startTimers(&net, period * 1000, gap * 1000);
+	}
 
-				for (i=0; i<NUMROUTERS; i++) {
-					if (neighborMatrix.r[5][i] != -1) {
-						n = sendto(sockfd[5], buf, BUFSIZE*sizeof(int), 0, (struct sockaddr *)&serveraddr[neighborMatrix.r[5][i]], clientlen);
-						if (n < 0)
-							error("Error sending to client");
-					}
-				}
-			}
-			if (count >= NUMROUTERS * 100) {
-				for (i=0; i<NUMROUTERS; i++) {
-					outputTable(network[i], true);
-				}
+	memset(&net.stats, 0, sizeof(net.stats));
+	started = clockUsec(&net);
+	wall = nowUsec();
+	/* begin by having the starting router advertise its table */
+	if (supervise)
+		net.kicking = start;
+	else if (!synchronous)
+		net.transport->kick(&net, start);
+
+stabilize:
+	printf("Stabilizing network...");
+	fflush(stdout);
+	if (net.numProcesses > 0) {
+		converged = runProcesses(&net, started);
+	} else if (net.sim != NULL) {
+		net.sim->settled = wall;
+		converged = runSimulation(&net, started);
+		net.sim->settled -= wall;
+		wall = nowUsec() - wall;
+	} else if (net.rounds != NULL) {
+		converged = runRounds(&net);
+	} else {
+		converged = net.numWorkers > 0 ? runWorkers(&net, started) : runNetwork(&net, started);
+	}
+	for (i=0; i<net.numRouters; i++) {
+		outputTable(&net, &net.routers[i], true);
+	}
 
-				stableState = true;
-				// printf("\n\nFINAL ROUTER INFO:\n\n");
-				// printf("ROUTER A:\n\n");
-				// printRouter(&tableA);
-				// printf("\n\nROUTER B:\n\n");
-				// printRouter(&tableB);
-				// printf("\n\nROUTER C:\n\n");
-				// printRouter(&tableC);
-				// printf("\n\nROUTER D:\n\n");
-				// printRouter(&tableD);
-				// printf("\n\nROUTER E:\n\n");
-				// printRouter(&tableE);
-				// printf("\n\nROUTER F:\n\n");
-				// printRouter(&tableF);
-				printf("[OK]\n\n");
+	if (net.rounds != NULL) {
+		printf("[OK] converged in %.3f s\n", (converged - started) / 1e6);
+		printRounds(&net);
+	} else {
+		printf("[OK] %lu DVs, %lu bytes, %lu send and %lu receive calls, converged in %.3f s\n",
+			net.stats.datagramsSent, net.stats.bytesSent, net.stats.sendCalls, net.stats.receiveCalls,
+			(converged - started) / 1e6);
+	}
+	if (net.numWorkers > 0)
+		printf("%lu router tasks run, %lu stolen\n", net.stats.tasksRun, net.stats.tasksStolen);
+	if (net.sim != NULL)
+		printf("%.3f virtual s simulated in %.3f s, the last change %.3f s in\n", (net.sim->now - started) / 1e6,
+			wall / 1e6, net.sim->settled / 1e6);
+	printProcesses(&net);
+	if (oracle)
+		checkSolution(&net, threads);
+	printf("\n");
 choose_action:
-				printf("Press 1<ENTER> to kill a router\nPress 2<ENTER> to send packet across the network\nPress 3<ENTER> to profile the network\nPress 4<ENTER> to exit\n-> ");
-				// steady state
-				// scan for input to send a packe
-				int option, k; // kill router, or send packet from x to y
-				char toKill, srcRouter, dstRouter;
-				scanf("%d", &option);
-				switch (option)
-				{
-					case 1:
-						printf("Label of router to kill (A-F):\n-> ");
-						scanf("\n%c", &toKill);
-						printf("Killing router %c\n", toupper(toKill));
-						int n;
-/*
-                                		struct timeval tv;
-                                		tv.tv_usec = 500000;
-*/
-                                		for (k = 0; k < NUMROUTERS; k++)
-                                		{
-							printf("Clearing Router %c's input buffers...", (char) k + 'A');
-                                        		FD_ZERO(&socks);
-                                        		FD_SET(sockfd[k], &socks);
-                                                        while ( (n = recvfrom(sockfd[k], buf, BUFSIZE*sizeof(int), 0, (struct sockaddr *)&clientaddr, &clientlen)) > 0)
-                                                        {
-//                                                                printf("%d %d\n", k, n);
-                                                        }
-							printf("[OK]\n");
-						}
-						reinitializeTopologyFile(toupper(toKill), nKills);
-						killedRouters[toupper(toKill) - 'A'] = 1;
-						nKills++;
-						goto re_initialize;
-
-						// will never reach this point
-						break;
-					case 2:
-						printf("Label of source router (A-F):\n-> ");
-						scanf("%c", &srcRouter);
-						srcRouter = getchar();
-						srcRouter = toupper(srcRouter);
-						printf("Label of destination router (A-F):\n-> ");
-						scanf("%c", &dstRouter);
-						dstRouter = getchar();
-						dstRouter = toupper(dstRouter);
-						printf("Routing a packet from Router %c to Router %c...", srcRouter, dstRouter);
-						struct packet p = { 'd', "message", srcRouter, dstRouter, 0, 0 };
-						forwardPacket(&p, network);
-						printf("[OK]\n\n");
-						goto choose_action;
-						break;
-					case 3:
-						printf("Routing tables:\n\n");
-						for (k = 0; k < NUMROUTERS; k++)
-						{
-							printf("\nRouter %c:\n\n", 'A' + k);
-							printRouter(network[k]);
-						}
-						goto choose_action;
-						break;
-					case 4:
-						printf("Killing all routers.\n");
-						
-/*
-                                		struct timeval tv;
-                                		tv.tv_usec = 500000;
-*/
-                                		for (k = 0; k < NUMROUTERS; k++)
-                                		{
-							printf("Clearing Router %c's input buffers...", (char) k + 'A');
-                                        		FD_ZERO(&socks);
-                                        		FD_SET(sockfd[k], &socks);
-                                                        while ( (n = recvfrom(sockfd[k], buf, BUFSIZE*sizeof(int), 0, (struct sockaddr *)&clientaddr, &clientlen)) > 0)
-                                                        {
-//                                                                printf("%d %d\n", k, n);
-                                                        }
-							printf("[OK]\n");
-						}
-						break;
-						
-				} 
-				break;
+	printf("Press 1<ENTER> to kill a router\nPress 2<ENTER> to send packet across the network\nPress 3<ENTER> to profile the network\nPress 4<ENTER> to exit\n-> ");
+	// steady state
+	// scan for input to send a packe
+	int option = 4, k; // kill router, or send packet from x to y
+	int toKill, srcRouter, dstRouter;
+	if (scanf("%d", &option) != 1)
+		option = 4;
+	switch (option)
+	{
+		case 1:
+			printf("Label of router to kill:\n-> ");
+			if ((toKill = readRouter(&net)) < 0) {
+				printf("Unknown router\n");
+				goto choose_action;
 			}
-		}
+			printf("Killing router %s\n", routerName(&net, toKill));
+			if (net.numProcesses > 0)
+				drainProcesses(&net);
+			else if (net.transport != NULL)
+				drainSockets(&net);
+			reinitializeTopologyFile(filepath, routerName(&net, toKill));
+			memset(&net.stats, 0, sizeof(net.stats));
+			started = clockUsec(&net);
+			wall = nowUsec();
+			net.killing = toKill;
+			goto stabilize;
+
+			// will never reach this point
+			break;
+		case 2:
+			printf("Label of source router:\n-> ");
+			srcRouter = readRouter(&net);
+			printf("Label of destination router:\n-> ");
+			dstRouter = readRouter(&net);
+			if (srcRouter < 0 || dstRouter < 0) {
+				printf("Unknown router\n");
+				goto choose_action;
+			}
+			printf("Routing a packet from Router %s to Router %s...", routerName(&net, srcRouter), routerName(&net, dstRouter));
+			struct packet p = { 'd', "message", srcRouter, dstRouter, 0, 0 };
+			printf(forwardPacket(&p, &net) ? "[OK]\n\n" : "[DROPPED]\n\n");
+			goto choose_action;
+			break;
+		case 3:
+			printf("Routing tables:\n\n");
+			for (k = 0; k < net.numRouters; k++)
+			{
+				printf("\nRouter %s:\n\n", routerName(&net, k));
+				printRouter(&net, &net.routers[k]);
+			}
+			goto choose_action;
+			break;
+		case 4:
+		default:
+			printf("Killing all routers.\n");
+			if (net.numProcesses > 0)
+				drainProcesses(&net);
+			else if (net.transport != NULL)
+				drainSockets(&net);
+			break;
+	}
+
+	if (net.numProcesses > 0) {
+		endProcesses(&net);
+	} else if (net.sim != NULL) {
+		closeSimulation(&net);
+	} else if (net.rounds != NULL) {
+		closeRounds(&net);
+	} else {
+		for (i=0; i<net.numRouters; i++)
+			close(net.sockfd[i]);
+		close(net.epollfd);
 	}
+	if (net.ringed)
+		uringTeardown(&net);
+	if (net.numWorkers > 0)
+		freeWorkers(&net);
+	if (inProcess)
+		closeMailboxes(&net);
+	flushLogs(&net);
+	for (i=0; i<net.numRouters; i++)
+		free(net.routers[i].log);
+	arenaFree(&net.arena);
+	freeTopology(&net.topo);
+	return 0;
 }
@@ -0,0 +1,699 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <endian.h> /* htole32 */
+#include <stdbool.h> /* boolean */
+#include <limits.h> /* INT_MAX */
+#include <unistd.h>
+#include <math.h>
+#include <arpa/inet.h>
+
+/* topogen: writes benchmark topologies for the router, either as text in the
+ * sample.txt format or as the binary edge list my-router.c also loads.
+ * Every undirected link is written in both directions with the same cost.
+ */
+
+#define BASEPORT	10000
+#define MAXPORT		65535
+
+/* Must match the binary topology layout read by loadTopology() in my-router.c. */
+#define TOPOMAGIC	"DVTB"
+#define TOPOVERSION	2
+#define LABELSIZE	12	/* "R", the digits of INT_MAX and the NUL */
+
+struct topologyHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t numRouters;
+	uint32_t numLinks;
+	uint64_t namesSize;
+};
+
+/* Where routers listen: without a base address, on their own ports of the
+ * default address; with one, router i on the i-th address after it and the
+ * base port. Addresses are IPv6, IPv4 mapped.
+ */
+struct addressing
+{
+	int basePort;
+	bool given;
+	bool v4;
+	unsigned char base[16];
+};
+
+struct edge
+{
+	int u;
+	int v;
+	int cost;
+};
+
+struct graph
+{
+	int numRouters;
+	int numEdges;
+	int capacity;
+	struct edge *edges;
+	uint64_t *seen;		/* open-addressed set of u,v pairs, 0 for empty */
+	size_t seenMask;
+};
+
+struct costModel
+{
+	char kind;		/* 'c'onstant, 'u'niform or 'e'xponential */
+	int lo;
+	int hi;
+	double mean;
+};
+
+void error(char *msg) {
+	perror(msg);
+	exit(1);
+}
+
+/* nextRandom()
+ *
+ * splitmix64, so a seed gives the same topology on every platform.
+ */
+uint64_t nextRandom(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+/* randomBelow()
+ *
+ * Returns a uniform random integer in [0, n).
+ */
+uint64_t randomBelow(uint64_t *state, uint64_t n)
+{
+	uint64_t limit = UINT64_MAX - UINT64_MAX % n;
+	uint64_t r;
+	do {
+		r = nextRandom(state);
+	} while (r >= limit);
+	return r % n;
+}
+
+/* drawCost()
+ *
+ * Returns a link cost drawn from the cost model, always at least 1.
+ */
+int drawCost(struct costModel *model, uint64_t *state)
+{
+	double u;
+
+	switch (model->kind)
+	{
+		case 'u':
+			return model->lo + (int) randomBelow(state, (uint64_t) (model->hi - model->lo) + 1);
+		case 'e':
+			u = (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+			u = 1.0 + floor(-model->mean * log(1.0 - u));
+			return u > INT_MAX - 1 ? INT_MAX - 1 : (int) u;
+		default:
+			return model->lo;
+	}
+}
+
+/* parseCostModel()
+ *
+ * Parses const:C, uniform:LO:HI or exp:MEAN.
+ */
+bool parseCostModel(const char *spec, struct costModel *model)
+{
+	if (sscanf(spec, "const:%d", &model->lo) == 1 && model->lo >= 1) {
+		model->kind = 'c';
+		return true;
+	}
+	if (sscanf(spec, "uniform:%d:%d", &model->lo, &model->hi) == 2 && model->lo >= 1 && model->hi >= model->lo) {
+		model->kind = 'u';
+		return true;
+	}
+	if (sscanf(spec, "exp:%lf", &model->mean) == 1 && model->mean > 0) {
+		model->kind = 'e';
+		return true;
+	}
+	return false;
+}
+
+/* edgeKey()
+ *
+ * Returns the set key of the undirected pair u,v; never 0.
+ */
+uint64_t edgeKey(int u, int v)
+{
+	if (u > v) {
+		int t = u;
+		u = v;
+		v = t;
+	}
+	return ((uint64_t) u << 32 | (uint32_t) v) + 1;
+}
+
+/* initGraph()
+ *
+ * Prepares an empty graph expecting about the given number of edges.
+ */
+void initGraph(struct graph *g, int numRouters, size_t expectedEdges)
+{
+	size_t size = 64;
+
+	while (size < 2 * expectedEdges)
+		size *= 2;
+	g->numRouters = numRouters;
+	g->numEdges = 0;
+	g->capacity = 0;
+	g->edges = NULL;
+	g->seen = calloc(size, sizeof(uint64_t));
+	if (g->seen == NULL)
+		error("Error allocating graph");
+	g->seenMask = size - 1;
+}
+
+/* growSeen()
+ *
+ * Doubles the edge set once it is half full.
+ */
+void growSeen(struct graph *g)
+{
+	size_t oldSize = g->seenMask + 1, k, s;
+	uint64_t *old = g->seen;
+
+	g->seen = calloc(2 * oldSize, sizeof(uint64_t));
+	if (g->seen == NULL)
+		error("Error allocating graph");
+	g->seenMask = 2 * oldSize - 1;
+	for (k = 0; k < oldSize; k++) {
+		if (old[k] == 0)
+			continue;
+		for (s = (old[k] * 0x9e3779b97f4a7c15ull) & g->seenMask; g->seen[s] != 0; s = (s + 1) & g->seenMask)
+			;
+		g->seen[s] = old[k];
+	}
+	free(old);
+}
+
+/* addEdge()
+ *
+ * Adds the undirected link u-v unless it is a self loop or already present.
+ * Returns true if the link was added.
+ */
+bool addEdge(struct graph *g, int u, int v, int cost)
+{
+	uint64_t key = edgeKey(u, v);
+	size_t s;
+
+	if (u == v)
+		return false;
+	for (s = (key * 0x9e3779b97f4a7c15ull) & g->seenMask; g->seen[s] != 0; s = (s + 1) & g->seenMask) {
+		if (g->seen[s] == key)
+			return false;
+	}
+	g->seen[s] = key;
+
+	if (g->numEdges == g->capacity) {
+		g->capacity = g->capacity ? g->capacity * 2 : 1024;
+		g->edges = realloc(g->edges, g->capacity * sizeof(struct edge));
+		if (g->edges == NULL)
+			error("Error allocating graph");
+	}
+	g->edges[g->numEdges].u = u;
+	g->edges[g->numEdges].v = v;
+	g->edges[g->numEdges].cost = cost;
+	g->numEdges++;
+
+	if ((size_t) g->numEdges * 2 > g->seenMask)
+		growSeen(g);
+	return true;
+}
+
+/* findRoot()
+ *
+ * Union-find lookup with path halving.
+ */
+int findRoot(int *parent, int x)
+{
+	while (parent[x] != x) {
+		parent[x] = parent[parent[x]];
+		x = parent[x];
+	}
+	return x;
+}
+
+/* connectComponents()
+ *
+ * Links every connected component to the next one so the network is
+ * connected, adding one link per extra component.
+ */
+void connectComponents(struct graph *g, struct costModel *model, uint64_t *state)
+{
+	int *parent = malloc(g->numRouters * sizeof(int));
+	int i, last = -1;
+
+	if (parent == NULL)
+		error("Error allocating graph");
+	for (i = 0; i < g->numRouters; i++)
+		parent[i] = i;
+	for (i = 0; i < g->numEdges; i++)
+		parent[findRoot(parent, g->edges[i].u)] = findRoot(parent, g->edges[i].v);
+	for (i = 0; i < g->numRouters; i++) {
+		if (findRoot(parent, i) != i)
+			continue;
+		if (last >= 0)
+			addEdge(g, last, i, drawCost(model, state));
+		last = i;
+	}
+	free(parent);
+}
+
+/* generateRandom()
+ *
+ * Erdos-Renyi graph with n*degree/2 links drawn uniformly among all pairs.
+ */
+void generateRandom(struct graph *g, int degree, struct costModel *model, uint64_t *state)
+{
+	int n = g->numRouters;
+	double maxEdges = (double) n * (n - 1) / 2;
+	double want = (double) n * degree / 2;
+	long long target = (long long) (want < maxEdges ? want : maxEdges);
+
+	while (g->numEdges < target)
+		addEdge(g, (int) randomBelow(state, n), (int) randomBelow(state, n), drawCost(model, state));
+}
+
+/* generateGrid()
+ *
+ * width x height grid with 4-neighbor links, wrapping around as a torus when
+ * asked to.
+ */
+void generateGrid(struct graph *g, int width, bool torus, struct costModel *model, uint64_t *state)
+{
+	int n = g->numRouters;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		int x = i % width, y = i / width;
+		if (x + 1 < width && i + 1 < n)
+			addEdge(g, i, i + 1, drawCost(model, state));
+		else if (torus && width > 2)
+			addEdge(g, i, y * width, drawCost(model, state));
+		if (i + width < n)
+			addEdge(g, i, i + width, drawCost(model, state));
+		else if (torus && i >= 2 * width)
+			addEdge(g, i, x, drawCost(model, state));
+	}
+}
+
+/* generateRing()
+ *
+ * Ring where each router links to its degree/2 nearest routers on each side.
+ */
+void generateRing(struct graph *g, int degree, struct costModel *model, uint64_t *state)
+{
+	int n = g->numRouters;
+	int reach = degree / 2 > 0 ? degree / 2 : 1;
+	int i, k;
+
+	for (i = 0; i < n; i++) {
+		for (k = 1; k <= reach; k++)
+			addEdge(g, i, (i + k) % n, drawCost(model, state));
+	}
+}
+
+/* generateFatTree()
+ *
+ * k-ary fat tree of switches: (k/2)^2 core, then k pods of k/2 aggregation
+ * and k/2 edge switches, every aggregation switch linked to every edge switch
+ * in its pod and to k/2 core switches.
+ */
+void generateFatTree(struct graph *g, int k, struct costModel *model, uint64_t *state)
+{
+	int half = k / 2;
+	int core = half * half;
+	int pod, a, e, c;
+
+	for (pod = 0; pod < k; pod++) {
+		int aggBase = core + pod * k;
+		int edgeBase = aggBase + half;
+		for (a = 0; a < half; a++) {
+			for (e = 0; e < half; e++)
+				addEdge(g, aggBase + a, edgeBase + e, drawCost(model, state));
+			for (c = 0; c < half; c++)
+				addEdge(g, aggBase + a, a * half + c, drawCost(model, state));
+		}
+	}
+}
+
+/* generatePowerLaw()
+ *
+ * Barabasi-Albert preferential attachment: each new router links to degree/2
+ * existing routers picked in proportion to their degree.
+ */
+void generatePowerLaw(struct graph *g, int degree, struct costModel *model, uint64_t *state)
+{
+	int n = g->numRouters;
+	int m = degree / 2 > 0 ? degree / 2 : 1;
+	size_t numEnds = 0, capacity = 2 * (size_t) n * m + 2 * (size_t) m * m;
+	int *ends = malloc(capacity * sizeof(int));	/* each router once per link end */
+	int i, j;
+
+	if (ends == NULL)
+		error("Error allocating graph");
+
+	// start from a small clique so every early router has some degree
+	for (i = 0; i <= m && i < n; i++) {
+		for (j = 0; j < i; j++) {
+			if (addEdge(g, i, j, drawCost(model, state))) {
+				ends[numEnds++] = i;
+				ends[numEnds++] = j;
+			}
+		}
+	}
+	for (; i < n; i++) {
+		int added = 0, tries = 0;
+		while (added < m && tries++ < 16 * m) {
+			int target = numEnds ? ends[randomBelow(state, numEnds)] : 0;
+			if (addEdge(g, i, target, drawCost(model, state))) {
+				ends[numEnds++] = i;
+				ends[numEnds++] = target;
+				added++;
+			}
+		}
+	}
+	free(ends);
+}
+
+/* routerLabel()
+ *
+ * Names routers A, B, ... for small networks and R<id> otherwise, zero padded
+ * so that name order is id order.
+ */
+void routerLabel(char label[LABELSIZE], int id, int n)
+{
+	int width = 1, k;
+
+	if (n <= 26) {
+		snprintf(label, LABELSIZE, "%c", 'A' + id);
+		return;
+	}
+	for (k = n - 1; k >= 10; k /= 10)
+		width++;
+	snprintf(label, LABELSIZE, "R%0*d", width, id);
+}
+
+/* parseBase()
+ *
+ * Parses an IPv4 or IPv6 base address into a, IPv4 mapped. Returns false if
+ * it is neither.
+ */
+bool parseBase(const char *text, struct addressing *a)
+{
+	memset(a->base, 0, sizeof(a->base));
+	a->v4 = false;
+	if (inet_pton(AF_INET6, text, a->base) == 1)
+		return true;
+	a->v4 = true;
+	a->base[10] = a->base[11] = 0xff;
+	return inet_pton(AF_INET, text, a->base + 12) == 1;
+}
+
+/* routerHost()
+ *
+ * Writes the address of router id into host: the base address plus id.
+ * Returns false if that runs past the end of the base's family.
+ */
+bool routerHost(struct addressing *a, int id, unsigned char *host)
+{
+	unsigned int carry = (unsigned int) id;
+	int k;
+
+	memcpy(host, a->base, 16);
+	for (k = 15; k >= (a->v4 ? 12 : 0) && carry > 0; k--) {
+		carry += host[k];
+		host[k] = carry & 0xff;
+		carry >>= 8;
+	}
+	return carry == 0;
+}
+
+/* routerAddress()
+ *
+ * Writes the text topology's address field of router id into buf.
+ */
+void routerAddress(char *buf, size_t size, struct addressing *a, int id)
+{
+	unsigned char host[16];
+	char text[INET6_ADDRSTRLEN];
+
+	if (!a->given) {
+		snprintf(buf, size, "%d", a->basePort + id);
+		return;
+	}
+	routerHost(a, id, host);
+	if (a->v4) {
+		inet_ntop(AF_INET, host + 12, text, sizeof(text));
+		snprintf(buf, size, "%s:%d", text, a->basePort);
+	} else {
+		inet_ntop(AF_INET6, host, text, sizeof(text));
+		snprintf(buf, size, "[%s]:%d", text, a->basePort);
+	}
+}
+
+/* writeText()
+ *
+ * Writes the topology in the sample.txt format.
+ */
+void writeText(FILE *f, struct graph *g, struct addressing *a)
+{
+	char u[LABELSIZE], v[LABELSIZE], ua[INET6_ADDRSTRLEN + 8], va[INET6_ADDRSTRLEN + 8];
+	int i;
+
+	for (i = 0; i < g->numEdges; i++) {
+		struct edge *e = &g->edges[i];
+		routerLabel(u, e->u, g->numRouters);
+		routerLabel(v, e->v, g->numRouters);
+		routerAddress(ua, sizeof(ua), a, e->u);
+		routerAddress(va, sizeof(va), a, e->v);
+		fprintf(f, "%s,%s,%s,%d\n", u, v, va, e->cost);
+		fprintf(f, "%s,%s,%s,%d\n", v, u, ua, e->cost);
+	}
+}
+
+/* writeBinary()
+ *
+ * Writes the topology as a binary edge list, little-endian on any host.
+ */
+void writeBinary(FILE *f, struct graph *g, struct addressing *a)
+{
+	struct topologyHeader h;
+	unsigned char host[16];
+	char label[LABELSIZE];
+	uint32_t offset = 0, word;
+	uint32_t link[3];
+	int i;
+
+	for (i = 0; i < g->numRouters; i++) {
+		routerLabel(label, i, g->numRouters);
+		offset += strlen(label) + 1;
+	}
+
+	memcpy(h.magic, TOPOMAGIC, 4);
+	h.version = htole32(TOPOVERSION);
+	h.numRouters = htole32(g->numRouters);
+	h.numLinks = htole32(2 * (uint32_t) g->numEdges);
+	h.namesSize = htole64((offset + 3) & ~3u);
+	fwrite(&h, sizeof(h), 1, f);
+
+	for (i = 0; i < g->numRouters; i++) {
+		word = htole32(a->given ? a->basePort : a->basePort + i);
+		fwrite(&word, sizeof(word), 1, f);
+	}
+	for (i = 0; i < g->numRouters; i++) {
+		memset(host, 0, sizeof(host));
+		if (a->given)
+			routerHost(a, i, host);
+		fwrite(host, 1, sizeof(host), f);
+	}
+	offset = 0;
+	for (i = 0; i < g->numRouters; i++) {
+		word = htole32(offset);
+		fwrite(&word, sizeof(word), 1, f);
+		routerLabel(label, i, g->numRouters);
+		offset += strlen(label) + 1;
+	}
+	for (i = 0; i < g->numRouters; i++) {
+		routerLabel(label, i, g->numRouters);
+		fwrite(label, 1, strlen(label) + 1, f);
+	}
+	for (; offset < le64toh(h.namesSize); offset++)
+		fputc('\0', f);
+
+	for (i = 0; i < g->numEdges; i++) {
+		struct edge *e = &g->edges[i];
+		link[0] = htole32((uint32_t) e->u);
+		link[1] = htole32((uint32_t) e->v);
+		link[2] = htole32((uint32_t) e->cost);
+		fwrite(link, sizeof(link), 1, f);
+		link[0] = htole32((uint32_t) e->v);
+		link[1] = htole32((uint32_t) e->u);
+		fwrite(link, sizeof(link), 1, f);
+	}
+}
+
+/* usage()
+ *
+ * Prints the command line options and exits.
+ */
+void usage(char *prog)
+{
+	fprintf(stderr, "usage: %s [options] random|grid|torus|ring|fattree|powerlaw\n"
+		"  -n routers     number of routers (default 6)\n"
+		"  -d degree      average degree for random, ring and powerlaw (default 4)\n"
+		"  -w width       grid and torus width (default sqrt(n))\n"
+		"  -k arity       fat tree arity, even; makes 5k^2/4 routers (default the\n"
+		"                 largest that fits in n; given both, n must match)\n"
+		"  -c costs       const:C, uniform:LO:HI or exp:MEAN (default uniform:1:10)\n"
+		"  -s seed        random seed (default 1)\n"
+		"  -p port        port of the first router (default %d)\n"
+		"  -a address     put router i on the i-th IPv4 or IPv6 address from this one,\n"
+		"                 all on the -p port, instead of on ports of their own\n"
+		"  -C             add links until the network is connected\n"
+		"  -b             write the binary edge list instead of text\n"
+		"  -o file        output file (default stdout)\n", prog, BASEPORT);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct costModel model = { 'u', 1, 10, 0 };
+	struct graph g;
+	uint64_t state = 1;
+	struct addressing addressing = { BASEPORT, false, false, { 0 } };
+	int n = 6, degree = 4, width = 0, arity = 0;
+	bool binary = false, connect = false, haveN = false;
+	char *outPath = NULL;
+	const char *kind;
+	FILE *f = stdout;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:d:w:k:c:s:p:a:Cbo:")) != -1) {
+		switch (opt)
+		{
+			case 'n':
+				n = atoi(optarg);
+				haveN = true;
+				break;
+			case 'd':
+				degree = atoi(optarg);
+				break;
+			case 'w':
+				width = atoi(optarg);
+				break;
+			case 'k':
+				arity = atoi(optarg);
+				break;
+			case 'c':
+				if (!parseCostModel(optarg, &model))
+					usage(argv[0]);
+				break;
+			case 's':
+				state = strtoull(optarg, NULL, 0);
+				break;
+			case 'p':
+				addressing.basePort = atoi(optarg);
+				break;
+			case 'a':
+				if (!parseBase(optarg, &addressing))
+					usage(argv[0]);
+				addressing.given = true;
+				break;
+			case 'C':
+				connect = true;
+				break;
+			case 'b':
+				binary = true;
+				break;
+			case 'o':
+				outPath = optarg;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind >= argc || degree < 1)
+		usage(argv[0]);
+	kind = argv[optind];
+
+	if (strcmp(kind, "fattree") == 0) {
+		// -k fixes n; -n alone picks the largest fat tree that fits
+		bool given = arity != 0;
+		if (arity == 0)
+			for (arity = 2; 5 * (arity + 2) * (arity + 2) / 4 <= n; arity += 2)
+				;
+		if (arity < 2 || arity % 2 != 0)
+			usage(argv[0]);
+		if (haveN && (given ? 5 * arity * arity / 4 != n : 5 * arity * arity / 4 > n)) {
+			fprintf(stderr, "A fat tree of arity %d has %d routers, not %d\n", arity, 5 * arity * arity / 4, n);
+			exit(1);
+		}
+		n = 5 * arity * arity / 4;
+	}
+	if (n < 2) {
+		fprintf(stderr, "Need at least 2 routers\n");
+		exit(1);
+	}
+	if (addressing.given) {
+		unsigned char last[16];
+		if (addressing.basePort < 1 || addressing.basePort > MAXPORT) {
+			fprintf(stderr, "Port %d does not fit below %d\n", addressing.basePort, MAXPORT + 1);
+			exit(1);
+		}
+		if (!routerHost(&addressing, n - 1, last)) {
+			fprintf(stderr, "%d addresses do not fit after the base address\n", n);
+			exit(1);
+		}
+	} else if (addressing.basePort < 1 || addressing.basePort + (long) n - 1 > MAXPORT) {
+		fprintf(stderr, "Ports %d..%ld do not fit below %d\n", addressing.basePort, addressing.basePort + (long) n - 1, MAXPORT + 1);
+		exit(1);
+	}
+
+	initGraph(&g, n, (size_t) n * degree / 2 + n);
+	if (strcmp(kind, "random") == 0) {
+		generateRandom(&g, degree, &model, &state);
+	} else if (strcmp(kind, "grid") == 0 || strcmp(kind, "torus") == 0) {
+		if (width == 0)
+			width = (int) ceil(sqrt((double) n));
+		if (width < 1)
+			usage(argv[0]);
+		generateGrid(&g, width, strcmp(kind, "torus") == 0, &model, &state);
+	} else if (strcmp(kind, "ring") == 0) {
+		generateRing(&g, degree, &model, &state);
+	} else if (strcmp(kind, "fattree") == 0) {
+		generateFatTree(&g, arity, &model, &state);
+	} else if (strcmp(kind, "powerlaw") == 0) {
+		generatePowerLaw(&g, degree, &model, &state);
+	} else {
+		usage(argv[0]);
+	}
+	if (connect)
+		connectComponents(&g, &model, &state);
+
+	if (outPath != NULL && (f = fopen(outPath, binary ? "wb" : "w")) == NULL)
+		error("Error opening output file");
+	if (binary)
+		writeBinary(f, &g, &addressing);
+	else
+		writeText(f, &g, &addressing);
+	if (fclose(f) != 0)
+		error("Error writing output file");
+
+	fprintf(stderr, "%s: %d routers, %d links\n", kind, g.numRouters, 2 * g.numEdges);
+	free(g.edges);
+	free(g.seen);
+	return 0;
+}